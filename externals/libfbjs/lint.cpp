@@ -0,0 +1,141 @@
+#include "lint.hpp"
+#include <algorithm>
+#include <stdio.h>
+
+using namespace fbjs;
+using namespace std;
+
+// Whether an identifier declares the binding it refers to rather than uses
+// it. A var can be declared more than once.
+static bool isDeclaration(const binding_t& binding, const NodeIdentifier* identifier) {
+  if (identifier == binding.declaration) {
+    return true;
+  }
+  const Node* parent = identifier->parent();
+  if (parent == NULL) {
+    return false;
+  }
+  if (parent->kind() == NODE_VAR_DECLARATION) {
+    return true;
+  }
+  return parent->kind() == NODE_ASSIGNMENT &&
+    parent->childNodes().front() == identifier &&
+    parent->parent() != NULL &&
+    parent->parent()->kind() == NODE_VAR_DECLARATION;
+}
+
+static bool isUsed(const binding_t& binding) {
+  for (vector<NodeIdentifier*>::const_iterator ii = binding.references.begin(); ii != binding.references.end(); ++ii) {
+    if (!isDeclaration(binding, *ii)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void report(vector<lint_t>& lints, lint_enum type, unsigned int lineno,
+                   const string& name, const string& message) {
+  lint_t lint;
+  lint.type = type;
+  lint.lineno = lineno;
+  lint.name = name;
+  lint.message = message;
+  lints.push_back(lint);
+}
+
+static bool byLine(const lint_t& left, const lint_t& right) {
+  return left.lineno < right.lineno;
+}
+
+vector<lint_t> fbjs::lint(const ScopeTree& tree) {
+  vector<lint_t> lints;
+  char line[16];
+
+  // Undeclared globals are all in the global scope, wherever they're used
+  const scope_t& global = tree.scope(0);
+  for (vector<unsigned int>::const_iterator ii = global.bindings.begin(); ii != global.bindings.end(); ++ii) {
+    const binding_t& binding = tree.binding(*ii);
+    if (binding.type != BINDING_UNDECLARED) {
+      continue;
+    }
+    const string& name = tree.name(binding.name);
+    for (vector<NodeIdentifier*>::const_iterator jj = binding.writes.begin(); jj != binding.writes.end(); ++jj) {
+      report(lints, LINT_IMPLICIT_GLOBAL, (*jj)->lineno(), name,
+        name + " is assigned to without being declared, which makes it a global");
+    }
+  }
+
+  for (size_t ii = 1; ii < tree.scopeCount(); ++ii) {
+    const scope_t& scope = tree.scope(ii);
+    bool uses_arguments = false;
+    unsigned int last_param = ScopeTree::NONE;
+    for (vector<unsigned int>::const_iterator jj = scope.bindings.begin(); jj != scope.bindings.end(); ++jj) {
+      const binding_t& binding = tree.binding(*jj);
+      const string& name = tree.name(binding.name);
+      if (binding.type == BINDING_ARGUMENTS) {
+        uses_arguments = true;
+        continue;
+      }
+      if (binding.type == BINDING_FUNCTION_NAME || binding.declaration == NULL) {
+        continue;
+      }
+      unsigned int lineno = binding.declaration->lineno();
+
+      unsigned int outer = tree.lookup(scope.parent, name);
+      if (outer != ScopeTree::NONE && tree.binding(outer).declaration != NULL) {
+        snprintf(line, sizeof(line), "%u", tree.binding(outer).declaration->lineno());
+        report(lints, LINT_SHADOW, lineno, name,
+          name + " hides the " + name + " declared on line " + line);
+      }
+
+      if (binding.type == BINDING_PARAM) {
+        last_param = *jj;
+      } else if ((binding.type == BINDING_VAR || binding.type == BINDING_FUNCTION) &&
+                 !scope.contains_eval && !isUsed(binding)) {
+        report(lints, LINT_UNUSED_VAR, lineno, name,
+          string(binding.type == BINDING_VAR ? "var " : "function ") + name + " is never used");
+      }
+    }
+
+    // Parameters before one that's used have to be there to keep it in its
+    // place, so only the ones after the last used one are unused.
+    if (uses_arguments || scope.contains_eval || last_param == ScopeTree::NONE) {
+      continue;
+    }
+    vector<lint_t> unused;
+    for (vector<unsigned int>::const_iterator jj = scope.bindings.begin(); jj != scope.bindings.end(); ++jj) {
+      const binding_t& binding = tree.binding(*jj);
+      if (binding.type != BINDING_PARAM) {
+        continue;
+      }
+      if (isUsed(binding)) {
+        unused.clear();
+      } else {
+        const string& name = tree.name(binding.name);
+        report(unused, LINT_UNUSED_PARAM, binding.declaration->lineno(), name,
+          "parameter " + name + " is never used");
+      }
+      if (*jj == last_param) {
+        break;
+      }
+    }
+    lints.insert(lints.end(), unused.begin(), unused.end());
+  }
+
+  stable_sort(lints.begin(), lints.end(), byLine);
+  return lints;
+}
+
+const char* fbjs::lintName(lint_enum type) {
+  switch (type) {
+    case LINT_IMPLICIT_GLOBAL:
+      return "implicit-global";
+    case LINT_UNUSED_VAR:
+      return "unused-var";
+    case LINT_UNUSED_PARAM:
+      return "unused-param";
+    case LINT_SHADOW:
+      return "shadow";
+  }
+  return "lint";
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "scope.hpp"
+#include <string>
+#include <vector>
+
+namespace fbjs {
+
+  enum lint_enum {
+    LINT_IMPLICIT_GLOBAL, // assigned to, or looped over by for-in, without being declared
+    LINT_UNUSED_VAR,      // a local var or function nothing refers to
+    LINT_UNUSED_PARAM,    // a parameter after the last one that's used
+    LINT_SHADOW,          // a local with the same name as a variable around it
+  };
+
+  struct lint_t {
+    lint_enum type;
+    unsigned int lineno;
+    std::string name;
+    std::string message;
+  };
+
+  //
+  // Finds likely mistakes in a program from its scopes, in line order. It
+  // reads what ScopeTree already knows, so linting a program that's been
+  // parsed for something else costs no second parse.
+  //
+  // Variables in a function that calls eval, or contains one that does, are
+  // never unused since the code eval runs could refer to them. Neither are
+  // the parameters of a function that refers to `arguments`. Top-level
+  // declarations are globals that other scripts can use, so they aren't
+  // checked either.
+  std::vector<lint_t> lint(const ScopeTree& tree);
+
+  // A short name for a kind of lint, like "implicit-global"
+  const char* lintName(lint_enum type);
+}
@@ -19,46 +19,211 @@
 */
 
 #include "node.hpp"
+#include "scope.hpp"
+#include <pthread.h>
+#include <unistd.h>
+#include <vector>
 
 extern "C" char* g_fmt(char*, double);
 using namespace std;
 using namespace fbjs;
 
+// dtoa keeps a global freelist and isn't safe to call from several render
+// threads at once.
+static pthread_mutex_t g_fmt_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Spots where a line may be broken without changing what the code means, ie
+// between statements and after commas. These only show up in the output while
+// guts->max_line is set and are all gone by the time Node::render() returns.
+// Nothing else rendered has a NUL in it: the scanner escapes them in string and
+// regex literals, and source with one in it isn't copied by RENDER_VERBATIM.
+static const char LINE_BREAK_MARKER = '\0';
+
+//
+// NodeIndex
+
+// Kinds of node that declare or refer to variables
+static bool binds_names(node_kind_t kind) {
+  switch (kind) {
+    case NODE_IDENTIFIER:
+    case NODE_FUNCTION_DECLARATION:
+    case NODE_FUNCTION_EXPRESSION:
+    case NODE_VAR_DECLARATION:
+    case NODE_TRY:
+    case NODE_WITH:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Every node would take itself out of the index as it's deleted, so this lets
+// go of them all up front.
+NodeIndex::~NodeIndex() {
+  for (int kind = 0; kind < NODE_KIND_COUNT; ++kind) {
+    for (vector<Node*>::iterator ii = this->_nodes[kind].begin(); ii != this->_nodes[kind].end(); ++ii) {
+      (*ii)->_index = NULL;
+    }
+  }
+}
+
+// Adds a subtree in source order. A node that's already in the index has the
+// rest of its subtree in there with it.
+void NodeIndex::add(Node* node) {
+  vector<Node*> pending(1, node);
+  while (!pending.empty()) {
+    node = pending.back();
+    pending.pop_back();
+    if (node == NULL || node->_index == this) {
+      continue;
+    }
+    if (node->_index != NULL) {
+      node->_index->unlink(node);
+    }
+    node->_index = this;
+    node->_indexSlot = this->_nodes[node->_kind].size();
+    this->_nodes[node->_kind].push_back(node);
+    this->_bindingsChanged = this->_bindingsChanged || binds_names(node->_kind);
+    pending.insert(pending.end(), node->_childNodes.rbegin(), node->_childNodes.rend());
+  }
+}
+
+void NodeIndex::remove(Node* node) {
+  vector<Node*> pending(1, node);
+  while (!pending.empty()) {
+    node = pending.back();
+    pending.pop_back();
+    if (node != NULL && node->_index == this) {
+      this->unlink(node);
+      this->_bindingsChanged = this->_bindingsChanged || binds_names(node->_kind);
+      pending.insert(pending.end(), node->_childNodes.begin(), node->_childNodes.end());
+    }
+  }
+}
+
+// Takes one node out, moving the last node of its kind into its slot
+void NodeIndex::unlink(Node* node) {
+  vector<Node*>& nodes = this->_nodes[node->_kind];
+  Node* last = nodes.back();
+  nodes[node->_indexSlot] = last;
+  last->_indexSlot = node->_indexSlot;
+  nodes.pop_back();
+  node->_index = NULL;
+}
+
 //
 // Node: All other nodes inherit from this.
-Node::Node(const unsigned int lineno /* = 0 */) : _lineno(lineno) {}
+Node::Node(const unsigned int lineno /* = 0 */) : _lineno(lineno), _kind(NODE_GENERIC), _parent(NULL), _renderCache(NULL), _sourceBegin(-1), _sourceEnd(-1), _sourceDirty(false), _slots(0), _indexSlot(0), _index(NULL) {}
+
+// Deleting, cloning and comparing nodes all work their way down the tree, each
+// type handling its own fields and Node handling the children. They recurse
+// as usual down to MAX_RECURSION levels. Past that they switch to an explicit
+// stack: a nested clone or compare just queues its node up and returns, and
+// the call that reached the limit works through the queue. Machine-generated
+// code can nest deep enough to overflow the C stack, but ordinary code never
+// pays for the queue.
+static const int MAX_RECURSION = 512;
+static __thread int delete_depth = 0;
+static __thread int clone_depth = 0;
+static __thread int compare_depth = 0;
+static __thread vector<pair<const Node*, Node*> >* clone_pending = NULL;
+static __thread vector<pair<const Node*, const Node*> >* compare_pending = NULL;
 
 Node::~Node() {
 
   // Delete all children of this node recursively
-  for (node_list_t::iterator node = this->_childNodes.begin(); node != this->_childNodes.end(); ++node) {
-    delete *node;
+  if (delete_depth < MAX_RECURSION) {
+    ++delete_depth;
+    for (node_list_t::iterator node = this->_childNodes.begin(); node != this->_childNodes.end(); ++node) {
+      delete *node;
+    }
+    --delete_depth;
+  } else {
+    // Every node is emptied before it's deleted, which leaves its own
+    // destructor nothing to do.
+    vector<Node*> pending(this->_childNodes.begin(), this->_childNodes.end());
+    while (!pending.empty()) {
+      Node* node = pending.back();
+      pending.pop_back();
+      if (node != NULL) {
+        pending.insert(pending.end(), node->_childNodes.begin(), node->_childNodes.end());
+        node->_childNodes.clear();
+        delete node;
+      }
+    }
+  }
+  if (this->_index != NULL) {
+    this->_index->unlink(this);
   }
+  delete this->_renderCache;
 }
 
 Node* Node::clone(Node* node) const {
   if (node == NULL) {
     node = new Node();
   }
-  for (node_list_t::const_iterator i = const_cast<Node*>(this)->childNodes().begin(); i != const_cast<Node*>(this)->childNodes().end(); ++i) {
-    node->appendChild((*i) == NULL ? NULL : (*i)->clone());
+  if (clone_pending != NULL) {
+    clone_pending->push_back(make_pair(this, node));
+  } else if (clone_depth < MAX_RECURSION) {
+    ++clone_depth;
+    try {
+      this->cloneChildren(node);
+    } catch (...) {
+      --clone_depth;
+      throw;
+    }
+    --clone_depth;
+  } else {
+    vector<pair<const Node*, Node*> > pending(1, make_pair(this, node));
+    clone_pending = &pending;
+    try {
+      while (!pending.empty()) {
+        pair<const Node*, Node*> next = pending.back();
+        pending.pop_back();
+        next.first->cloneChildren(next.second);
+      }
+    } catch (...) {
+      clone_pending = NULL;
+      throw;
+    }
+    clone_pending = NULL;
   }
   return node;
 }
 
+// The copies are brand new and have no render cache or source range to
+// invalidate, so this skips appendChild() and its walk up to the root.
+void Node::cloneChildren(Node* node) const {
+  for (node_list_t::const_iterator i = this->_childNodes.begin(); i != this->_childNodes.end(); ++i) {
+    Node* copy = (*i) == NULL ? NULL : (*i)->clone();
+    node->_childNodes.push_back(copy);
+    if (copy != NULL) {
+      copy->_parent = node;
+      copy->_position = --node->_childNodes.end();
+      copy->_slots = 1;
+    }
+  }
+}
+
 Node* Node::appendChild(Node* node) {
   this->_childNodes.push_back(node);
+  this->adopt(node, --this->_childNodes.end());
+  this->markDirty();
   return this;
 }
 
 Node* Node::prependChild(Node* node) {
   this->_childNodes.push_front(node);
+  this->adopt(node, this->_childNodes.begin());
+  this->markDirty();
   return this;
 }
 
 Node* Node::removeChild(node_list_t::iterator node_pos) {
   Node* node = (*node_pos);
+  this->release(node, node_pos);
   this->_childNodes.erase(node_pos);
+  this->markDirty();
   return node;
 }
 
@@ -68,10 +233,78 @@ Node* Node::replaceChild(Node* node, node_list_t::iterator node_pos) {
 }
 
 Node* Node::insertBefore(Node* node, node_list_t::iterator node_pos) {
-  this->_childNodes.insert(node_pos, node);
+  this->adopt(node, this->_childNodes.insert(node_pos, node));
+  this->markDirty();
   return node;
 }
 
+// A node counts the child list slots it's in, so one that's moved by putting
+// it in its new place before taking it out of the old one (like
+// replaceChild() does) never leaves the index on the way. Its parent and
+// position are always those of the slot it was put in last. A subtree that's
+// moved may have been moved into another scope.
+void Node::adopt(Node* node, node_list_t::iterator position) {
+  if (node != NULL) {
+    node->_parent = this;
+    node->_position = position;
+    ++node->_slots;
+    if (this->_index != NULL && node->_index != this->_index) {
+      this->_index->add(node);
+    } else if (this->_index != NULL && (binds_names(node->_kind) || !node->_childNodes.empty())) {
+      this->_index->_bindingsChanged = true;
+    }
+  }
+}
+
+void Node::release(Node* node, node_list_t::iterator position) {
+  if (node != NULL) {
+    if (node->_parent == this && node->_position == position) {
+      node->_parent = NULL;
+    }
+    if (--node->_slots == 0 && node->_index != NULL) {
+      node->_index->remove(node);
+    }
+  }
+}
+
+Node* Node::enclosingFunction() const {
+  for (Node* node = this->_parent; node != NULL; node = node->_parent) {
+    if (node->_kind == NODE_FUNCTION_DECLARATION || node->_kind == NODE_FUNCTION_EXPRESSION) {
+      return node;
+    }
+  }
+  return NULL;
+}
+
+bool Node::isCallee() const {
+  return this->_parent != NULL &&
+    (this->_parent->_kind == NODE_FUNCTION_CALL || this->_parent->_kind == NODE_FUNCTION_CONSTRUCTOR) &&
+    this->_position == this->_parent->_childNodes.begin();
+}
+
+void Node::markDirty() {
+
+  // Any change to a subtree changes the output of every node above it as well.
+  // Passes may edit disjoint subtrees from several threads, which meet here
+  // on their common ancestors, so the cache is swapped out atomically and
+  // only one of them gets to delete it.
+  for (Node* node = this; node != NULL; node = node->_parent) {
+    if (__atomic_load_n(&node->_renderCache, __ATOMIC_RELAXED) != NULL) {
+      delete __atomic_exchange_n(&node->_renderCache, (render_cache_t*)NULL, __ATOMIC_ACQ_REL);
+    }
+    __atomic_store_n(&node->_sourceDirty, true, __ATOMIC_RELAXED);
+  }
+}
+
+void Node::setSourceRange(int begin, int end) {
+
+  // The parser sets this once a node is complete, so whatever marked it dirty
+  // while its children were being attached doesn't count.
+  this->_sourceBegin = begin;
+  this->_sourceEnd = end;
+  this->_sourceDirty = false;
+}
+
 node_list_t& Node::childNodes() const {
   return const_cast<Node*>(this)->_childNodes;
 }
@@ -84,11 +317,65 @@ rope_t Node::render(node_render_enum opts /* = RENDER_NONE */) const {
   return this->render((int)opts);
 }
 
-rope_t Node::render(int opts) const {
+// Turns the last line break marker before each line runs past `max_line' bytes
+// into a newline and drops the rest of them. A line with no markers in it is
+// left long.
+static rope_t breakLines(const rope_t& rope, unsigned int max_line) {
+  const char* src = rope.c_str();
+  size_t len = rope.size();
+  string out;
+  out.reserve(len + len / max_line);
+  size_t line_start = 0;
+  size_t last_break = string::npos;
+  for (size_t ii = 0; ii < len; ++ii) {
+    char c = src[ii];
+    if (c == LINE_BREAK_MARKER) {
+      last_break = out.size();
+      continue;
+    }
+    out += c;
+    if (c == '\n') {
+      line_start = out.size();
+      last_break = string::npos;
+    } else if (out.size() - line_start > max_line && last_break != string::npos && last_break > line_start) {
+      out.insert(last_break, 1, '\n');
+      line_start = last_break + 1;
+      last_break = string::npos;
+    }
+  }
+  return rope_t(out.data(), out.size());
+}
+
+rope_t Node::render(int opts, unsigned int max_line /* = 0 */) const {
   render_guts_t guts;
   guts.pretty = opts & RENDER_PRETTY;
   guts.sanelineno = opts & RENDER_MAINTAIN_LINENO;
+  guts.cache = opts & RENDER_CACHE;
+  guts.threads = 1;
+  guts.source = NULL;
+  if (opts & RENDER_VERBATIM) {
+    const Node* root = this;
+    while (root->_parent != NULL) {
+      root = root->_parent;
+    }
+    const NodeProgram* program = dynamic_cast<const NodeProgram*>(root);
+    if (program != NULL && !program->source().empty() &&
+        (!max_line || program->source().find(LINE_BREAK_MARKER) == string::npos)) {
+      guts.source = &program->source();
+      guts.sanelineno = false;
+    }
+  }
+  if (opts & RENDER_PARALLEL) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > 1) {
+      guts.threads = cpus;
+    }
+  }
+  guts.max_line = max_line;
   guts.lineno = 1;
+  if (max_line) {
+    return breakLines(this->render(&guts, 0), max_line);
+  }
   return this->render(&guts, 0);
 }
 
@@ -157,6 +444,34 @@ rope_t Node::renderStatement(render_guts_t* guts, int indentation) const {
   return this->render(guts, indentation);
 }
 
+rope_t Node::renderCached(render_guts_t* guts, int indentation) const {
+
+  // Statement output only depends on the node itself and the line and
+  // indentation it starts on, so a clean statement can just hand back what it
+  // rendered last time.
+  render_cache_t* cache = this->_renderCache;
+  if (cache != NULL &&
+      cache->lineno_in == guts->lineno &&
+      cache->indentation == indentation &&
+      cache->pretty == guts->pretty &&
+      cache->sanelineno == guts->sanelineno &&
+      cache->max_line == guts->max_line) {
+    guts->lineno = cache->lineno_out;
+    return cache->rope;
+  }
+  if (cache == NULL) {
+    cache = this->_renderCache = new render_cache_t;
+  }
+  cache->lineno_in = guts->lineno;
+  cache->indentation = indentation;
+  cache->pretty = guts->pretty;
+  cache->sanelineno = guts->sanelineno;
+  cache->max_line = guts->max_line;
+  cache->rope = this->renderIndentedStatement(guts, indentation);
+  cache->lineno_out = guts->lineno;
+  return cache->rope;
+}
+
 rope_t Node::renderImplodeChildren(render_guts_t* guts, int indentation, const char* glue) const {
   rope_t ret;
   node_list_t::const_iterator i = this->_childNodes.begin();
@@ -167,6 +482,9 @@ rope_t Node::renderImplodeChildren(render_guts_t* guts, int indentation, const c
     i++;
     if (i != this->_childNodes.end()) {
       ret += glue;
+      if (guts->max_line && glue[0] == ',') {
+        ret += LINE_BREAK_MARKER;
+      }
     }
   }
   return ret;
@@ -189,19 +507,41 @@ bool Node::operator== (const Node &that) const {
   if (typeid(*this) != typeid(that)) {
     return false;
   }
-  node_list_t::iterator jj = that.childNodes().begin();
-  for (node_list_t::iterator ii = this->childNodes().begin(); ii != this->childNodes().end(); ++ii) {
-    if (**jj != **ii) {
-      return false;
-    }
-    if (++jj == that.childNodes().end()) {
-      if (++ii != this->childNodes().end()) {
+  if (compare_pending != NULL) {
+    compare_pending->push_back(make_pair(this, &that));
+    return true;
+  } else if (compare_depth < MAX_RECURSION) {
+    ++compare_depth;
+    bool equal = this->childNodesEqual(that);
+    --compare_depth;
+    return equal;
+  }
+
+  vector<pair<const Node*, const Node*> > pending(1, make_pair(this, &that));
+  compare_pending = &pending;
+  bool equal = true;
+  while (equal && !pending.empty()) {
+    pair<const Node*, const Node*> next = pending.back();
+    pending.pop_back();
+    equal = next.first->childNodesEqual(*next.second);
+  }
+  compare_pending = NULL;
+  return equal;
+}
+
+bool Node::childNodesEqual(const Node& that) const {
+  node_list_t::const_iterator ii = this->_childNodes.begin();
+  node_list_t::const_iterator jj = that._childNodes.begin();
+  for (; ii != this->_childNodes.end() && jj != that._childNodes.end(); ++ii, ++jj) {
+    if (*ii == NULL || *jj == NULL) {
+      if (*ii != *jj) {
         return false;
       }
-      break;
+    } else if (**ii != **jj) {
+      return false;
     }
   }
-  return true;
+  return ii == this->_childNodes.end() && jj == that._childNodes.end();
 }
 
 bool Node::operator!= (const Node &that) const {
@@ -210,28 +550,320 @@ bool Node::operator!= (const Node &that) const {
 
 //
 // NodeProgram: a javascript program
-NodeProgram::NodeProgram() : Node(1) {}
+NodeProgram::NodeProgram() : Node(1), _nodeIndex(NULL), _scopeTree(NULL) {
+  this->_kind = NODE_PROGRAM;
+}
+
+NodeProgram::~NodeProgram() {
+  delete this->_scopeTree;
+  delete this->_nodeIndex;
+}
+
+const ScopeTree* NodeProgram::scopes() {
+  if (this->_nodeIndex == NULL) {
+    return NULL;
+  }
+  if (this->_scopeTree == NULL || this->_nodeIndex->_bindingsChanged) {
+    delete this->_scopeTree;
+    this->_scopeTree = new ScopeTree(this);
+    this->_nodeIndex->_bindingsChanged = false;
+  }
+  return this->_scopeTree;
+}
+
+void NodeProgram::buildIndex() {
+  if (this->_nodeIndex == NULL) {
+    this->_nodeIndex = new NodeIndex;
+    this->_nodeIndex->add(this);
+  }
+}
 Node* NodeProgram::clone(Node* node) const {
   return Node::clone(new NodeProgram());
 }
 
+const std::string& NodeProgram::source() const {
+  return this->_source;
+}
+
+void NodeProgram::adoptSource(std::string& source) {
+
+  // The parser gives every statement its range; the top-level list spans the
+  // whole file so leading and trailing comments are kept too.
+  this->_source.swap(source);
+  if (!this->_childNodes.empty() && this->_childNodes.front() != NULL) {
+    this->_childNodes.front()->setSourceRange(0, this->_source.size());
+  }
+}
+
 //
 // NodeStatementList: a list of statements
-NodeStatementList::NodeStatementList(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeStatementList::NodeStatementList(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_STATEMENT_LIST;
+}
 Node* NodeStatementList::clone(Node* node) const {
   return Node::clone(new NodeStatementList());
 }
 
-rope_t NodeStatementList::render(render_guts_t* guts, int indentation) const {
+static rope_t renderStatementRange(node_list_t::const_iterator begin, node_list_t::const_iterator end, render_guts_t* guts, int indentation) {
   rope_t ret;
-  for (node_list_t::const_iterator i = this->_childNodes.begin(); i != this->_childNodes.end(); ++i) {
+  for (node_list_t::const_iterator i = begin; i != end; ++i) {
     if (*i != NULL) {
-      ret += (*i)->renderIndentedStatement(guts, indentation);
+      ret += guts->cache ? (*i)->renderCached(guts, indentation) : (*i)->renderIndentedStatement(guts, indentation);
+      if (guts->max_line) {
+        ret += LINE_BREAK_MARKER;
+      }
     }
   }
   return ret;
 }
 
+//
+// Parallel rendering of the top-level statement list. Every statement renders
+// independently of its siblings except for the lineno counter in guts, so the
+// list is cut into chunks which are rendered on worker threads under an
+// assumed starting lineno. The chunks are then stitched back together in order
+// and any chunk whose guess turned out to be wrong is rendered again inline.
+struct render_chunk_t {
+  node_list_t::const_iterator begin;
+  node_list_t::const_iterator end;
+  bool known;
+  unsigned int lineno_in;
+  unsigned int lineno_out;
+  rope_t rope;
+};
+
+struct render_job_t {
+  vector<render_chunk_t>* chunks;
+  const render_guts_t* guts;
+  int indentation;
+  size_t next;
+};
+
+static void* renderChunkWorker(void* arg) {
+  render_job_t* job = static_cast<render_job_t*>(arg);
+  while (true) {
+    size_t ii = __sync_fetch_and_add(&job->next, 1);
+    if (ii >= job->chunks->size()) {
+      break;
+    }
+    render_chunk_t& chunk = (*job->chunks)[ii];
+    if (!chunk.known) {
+      continue;
+    }
+    render_guts_t guts = *job->guts;
+    guts.threads = 1;
+    guts.lineno = chunk.lineno_in;
+    chunk.rope = renderStatementRange(chunk.begin, chunk.end, &guts, job->indentation);
+    chunk.lineno_out = guts.lineno;
+  }
+  return NULL;
+}
+
+rope_t NodeStatementList::render(render_guts_t* guts, int indentation) const {
+  if (guts->source != NULL) {
+    return this->renderVerbatim(guts, indentation);
+  }
+  size_t count = this->_childNodes.size();
+  if (guts->threads <= 1 || indentation != 0 || count < 16) {
+    return renderStatementRange(this->_childNodes.begin(), this->_childNodes.end(), guts, indentation);
+  }
+
+  // Cut the list into a few more chunks than there are threads so uneven
+  // statements still balance out.
+  size_t chunk_count = min(count, (size_t)guts->threads * 4);
+  vector<render_chunk_t> chunks(chunk_count);
+  node_list_t::const_iterator ii = this->_childNodes.begin();
+  for (size_t jj = 0; jj < chunk_count; ++jj) {
+    render_chunk_t& chunk = chunks[jj];
+    chunk.begin = ii;
+    for (size_t kk = count * jj / chunk_count; kk < count * (jj + 1) / chunk_count; ++kk) {
+      ++ii;
+    }
+    chunk.end = ii;
+
+    // Guess which line each chunk will start on. Without linenos the counter
+    // is only ever 1, or 2 once pretty output has started. With linenos the
+    // first statement catches up to its own line, so a chunk rendered from
+    // there only needs to be prefixed with however many newlines the catchup
+    // would have emitted. Statement lists don't catch up before rendering
+    // their children so they can't start a chunk.
+    chunk.known = true;
+    if (jj == 0) {
+      chunk.lineno_in = guts->lineno;
+    } else if (!guts->sanelineno) {
+      chunk.lineno_in = guts->pretty ? 2 : guts->lineno;
+    } else if (*chunk.begin != NULL && (*chunk.begin)->lineno() &&
+        dynamic_cast<NodeStatementList*>(*chunk.begin) == NULL) {
+      chunk.lineno_in = (*chunk.begin)->lineno();
+    } else {
+      chunk.known = false;
+    }
+  }
+
+  render_job_t job;
+  job.chunks = &chunks;
+  job.guts = guts;
+  job.indentation = indentation;
+  job.next = 0;
+  vector<pthread_t> workers;
+  for (unsigned int jj = 1; jj < guts->threads && jj < chunk_count; ++jj) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, renderChunkWorker, &job) == 0) {
+      workers.push_back(thread);
+    }
+  }
+  renderChunkWorker(&job);
+  for (vector<pthread_t>::iterator jj = workers.begin(); jj != workers.end(); ++jj) {
+    pthread_join(*jj, NULL);
+  }
+
+  rope_t ret;
+  for (vector<render_chunk_t>::iterator jj = chunks.begin(); jj != chunks.end(); ++jj) {
+    if (jj->known && jj->lineno_in == guts->lineno) {
+      ret += jj->rope;
+      guts->lineno = jj->lineno_out;
+    } else if (jj->known && guts->sanelineno && guts->lineno < jj->lineno_in) {
+      ret += rope_t(jj->lineno_in - guts->lineno, '\n');
+      ret += jj->rope;
+      guts->lineno = jj->lineno_out;
+    } else {
+      ret += renderStatementRange(jj->begin, jj->end, guts, indentation);
+    }
+  }
+  return ret;
+}
+
+//
+// Verbatim rendering. Statements which haven't changed since they were parsed
+// are copied straight out of the original source, and so is the whitespace
+// and comments between two such statements. Only modified statements go
+// through the regular renderer. This is meant to be used with RENDER_PRETTY.
+
+// Returns true if source[begin, end) has nothing but whitespace, comments and
+// `separator' in it.
+static bool isSourceTrivia(const string& source, int begin, int end, char separator) {
+  int ii = begin;
+  while (ii < end) {
+    char c = source[ii];
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\x0b' || c == '\x0c' || c == separator) {
+      ++ii;
+    } else if (c == '/' && ii + 1 < end && source[ii + 1] == '/') {
+      while (ii < end && source[ii] != '\n') {
+        ++ii;
+      }
+    } else if (c == '/' && ii + 1 < end && source[ii + 1] == '*') {
+      size_t close = source.find("*/", ii + 2);
+      if (close == string::npos || (int)close + 2 > end) {
+        return false;
+      }
+      ii = close + 2;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Whitespace a statement was indented with in the source. Returns false if
+// there's other code on the line before it.
+static bool sourceIndentation(const string& source, int offset, rope_t& indent) {
+  int ii = offset;
+  while (ii > 0 && (source[ii - 1] == ' ' || source[ii - 1] == '\t')) {
+    --ii;
+  }
+  if (ii > 0 && source[ii - 1] != '\n') {
+    return false;
+  }
+  indent = rope_t(source.data() + ii, offset - ii);
+  return true;
+}
+
+// Indentation level to regenerate a node at. Nodes which started their own
+// line keep the depth they had in the source so they line up with the copied
+// code around them.
+static int sourceIndentationLevel(const string& source, const Node* node, int indentation) {
+  rope_t indent;
+  if (!node->hasSourceRange() || !sourceIndentation(source, node->sourceBegin(), indent)) {
+    return indentation;
+  }
+  int width = 0;
+  for (rope_t::const_iterator ii = indent.begin(); ii != indent.end(); ++ii) {
+    width += *ii == '\t' ? 2 : 1;
+  }
+  return width / 2;
+}
+
+// Copied statements may have ended with an implicit semicolon, which is only
+// safe as long as the original line break after them comes along as well.
+static bool needsSemicolon(const Node* node) {
+  return dynamic_cast<const NodeExpression*>(node) != NULL ||
+    dynamic_cast<const NodeStatement*>(node) != NULL ||
+    dynamic_cast<const NodeLabel*>(node) != NULL;
+}
+
+rope_t NodeStatementList::renderVerbatim(render_guts_t* guts, int indentation) const {
+  const string& source = *guts->source;
+  bool toplevel = this->hasSourceRange() && dynamic_cast<const NodeProgram*>(this->_parent) != NULL;
+  if (toplevel && this->sourceClean()) {
+    guts->lineno = 2;
+    return rope_t(source.data() + this->_sourceBegin, this->_sourceEnd - this->_sourceBegin);
+  }
+
+  rope_t ret;
+  int prev_end = toplevel ? this->_sourceBegin : -1;
+  bool open = false;
+  for (node_list_t::const_iterator ii = this->_childNodes.begin(); ii != this->_childNodes.end(); ++ii) {
+    const Node* node = *ii;
+    if (node == NULL) {
+      continue;
+    }
+
+    // Keep the original whitespace in front of the statement if it came right
+    // after the last one we saw in the source, otherwise start a new line.
+    if (node->hasSourceRange() && prev_end >= 0 && prev_end <= node->sourceBegin() &&
+        isSourceTrivia(source, prev_end, node->sourceBegin(), ';')) {
+      ret += rope_t(source.data() + prev_end, node->sourceBegin() - prev_end);
+      guts->lineno = 2;
+    } else {
+      if (open) {
+        ret += ";";
+      }
+      if (guts->pretty) {
+        if (guts->lineno == 2) {
+          ret += "\n";
+          rope_t indent;
+          if (node->hasSourceRange() && sourceIndentation(source, node->sourceBegin(), indent)) {
+            ret += indent;
+          } else {
+            for (int jj = 0; jj < indentation; ++jj) {
+              ret += "  ";
+            }
+          }
+        }
+      }
+      guts->lineno = 2;
+    }
+
+    if (node->sourceClean()) {
+      ret += rope_t(source.data() + node->sourceBegin(), node->sourceEnd() - node->sourceBegin());
+      open = source[node->sourceEnd() - 1] != ';' && needsSemicolon(node);
+    } else {
+      ret += node->renderStatement(guts, sourceIndentationLevel(source, node, indentation));
+      open = false;
+    }
+    if (node->hasSourceRange()) {
+      prev_end = node->sourceEnd();
+    }
+  }
+
+  if (toplevel && prev_end >= 0 && isSourceTrivia(source, prev_end, this->_sourceEnd, ';')) {
+    ret += rope_t(source.data() + prev_end, this->_sourceEnd - prev_end);
+  } else if (open) {
+    ret += ";";
+  }
+  return ret;
+}
+
 rope_t NodeStatementList::renderBlock(bool must, render_guts_t* guts, int indentation) const {
   if (!must && this->empty()) {
     return rope_t(";");
@@ -274,7 +906,9 @@ rope_t NodeStatementList::renderStatement(render_guts_t* guts, int indentation)
 
 //
 // NodeExpression
-NodeExpression::NodeExpression(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeExpression::NodeExpression(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_EXPRESSION;
+}
 
 bool NodeExpression::isValidlVal() const {
   return false;
@@ -290,7 +924,9 @@ bool NodeExpression::compare(bool val) const {
 
 //
 // NodeNumericLiteral: it's a number. like 5. or 3.
-NodeNumericLiteral::NodeNumericLiteral(double value, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), value(value) {}
+NodeNumericLiteral::NodeNumericLiteral(double value, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), value(value) {
+  this->_kind = NODE_NUMERIC_LITERAL;
+}
 
 Node* NodeNumericLiteral::clone(Node* node) const {
   return new NodeNumericLiteral(this->value);
@@ -298,7 +934,9 @@ Node* NodeNumericLiteral::clone(Node* node) const {
 
 rope_t NodeNumericLiteral::render(render_guts_t* guts, int indentation) const {
   char buf[32];
+  pthread_mutex_lock(&g_fmt_mutex);
   g_fmt(buf, this->value);
+  pthread_mutex_unlock(&g_fmt_mutex);
   return rope_t(buf);
 }
 
@@ -313,7 +951,9 @@ bool NodeNumericLiteral::operator== (const Node &that) const {
 
 //
 // NodeStringLiteral: "Hello."
-NodeStringLiteral::NodeStringLiteral(const string &value, bool quoted, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), value(value), quoted(quoted) {}
+NodeStringLiteral::NodeStringLiteral(const string &value, bool quoted, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), value(value), quoted(quoted) {
+  this->_kind = NODE_STRING_LITERAL;
+}
 
 Node* NodeStringLiteral::clone(Node* node) const {
   return new NodeStringLiteral(this->value, this->quoted);
@@ -390,7 +1030,9 @@ bool NodeStringLiteral::operator== (const Node &that) const {
 
 //
 // NodeRegexLiteral: /foo|bar/
-NodeRegexLiteral::NodeRegexLiteral(const string &value, const string &flags, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), value(value), flags(flags) {}
+NodeRegexLiteral::NodeRegexLiteral(const string &value, const string &flags, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), value(value), flags(flags) {
+  this->_kind = NODE_REGEX_LITERAL;
+}
 
 Node* NodeRegexLiteral::clone(Node* node) const {
   return new NodeRegexLiteral(this->value, this->flags);
@@ -407,7 +1049,9 @@ bool NodeRegexLiteral::operator== (const Node &that) const {
 
 //
 // NodeBooleanLiteral: true or false
-NodeBooleanLiteral::NodeBooleanLiteral(bool value, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), value(value) {}
+NodeBooleanLiteral::NodeBooleanLiteral(bool value, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), value(value) {
+  this->_kind = NODE_BOOLEAN_LITERAL;
+}
 
 rope_t NodeBooleanLiteral::render(render_guts_t* guts, int indentation) const {
   return rope_t(this->value ? "true" : "false");
@@ -428,7 +1072,9 @@ bool NodeBooleanLiteral::operator== (const Node &that) const {
 
 //
 // NodeNullLiteral: null
-NodeNullLiteral::NodeNullLiteral(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeNullLiteral::NodeNullLiteral(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_NULL_LITERAL;
+}
 Node* NodeNullLiteral::clone(Node* node) const {
   return Node::clone(new NodeNullLiteral());
 }
@@ -439,7 +1085,9 @@ rope_t NodeNullLiteral::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeThis: this
-NodeThis::NodeThis(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeThis::NodeThis(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_THIS;
+}
 Node* NodeThis::clone(Node* node) const {
   return Node::clone(new NodeThis());
 }
@@ -450,7 +1098,9 @@ rope_t NodeThis::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeEmptyExpression
-NodeEmptyExpression::NodeEmptyExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeEmptyExpression::NodeEmptyExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_EMPTY_EXPRESSION;
+}
 Node* NodeEmptyExpression::clone(Node* node) const {
   return Node::clone(new NodeEmptyExpression());
 }
@@ -465,16 +1115,40 @@ rope_t NodeEmptyExpression::renderBlock(bool must, render_guts_t* guts, int inde
 
 //
 // NodeOperator: expression <op> expression
-NodeOperator::NodeOperator(node_operator_t op, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), op(op) {}
+NodeOperator::NodeOperator(node_operator_t op, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), op(op) {
+  this->_kind = NODE_OPERATOR;
+}
 
 Node* NodeOperator::clone(Node* node) const {
   return Node::clone(new NodeOperator(this->op));
 }
 
+// Binary operators are left associative, so a chain like a+b+c+... is a tree
+// as deep as the chain is long. Walk down the left operands in a loop and
+// render the chain from the inside out, instead of recursing into each one.
 rope_t NodeOperator::render(render_guts_t* guts, int indentation) const {
-  rope_t ret;
+  const Node* left = this->_childNodes.front();
+  if (left->kind() != NODE_OPERATOR) {
+    rope_t ret(left->render(guts, indentation));
+    this->renderOperator(ret, guts, indentation);
+    return ret;
+  }
+
+  vector<const NodeOperator*> chain(1, this);
+  while (left->kind() == NODE_OPERATOR) {
+    chain.push_back(static_cast<const NodeOperator*>(left));
+    left = static_cast<const NodeOperator*>(left)->_childNodes.front();
+  }
+  rope_t ret(left->render(guts, indentation));
+  for (vector<const NodeOperator*>::reverse_iterator node = chain.rbegin(); node != chain.rend(); ++node) {
+    (*node)->renderOperator(ret, guts, indentation);
+  }
+  return ret;
+}
+
+// Appends everything after the left operand
+void NodeOperator::renderOperator(rope_t& ret, render_guts_t* guts, int indentation) const {
   bool padding = true;
-  ret += this->_childNodes.front()->render(guts, indentation);
   if (guts->pretty) {
     padding = false;
     if (this->op != COMMA) {
@@ -582,7 +1256,6 @@ rope_t NodeOperator::render(render_guts_t* guts, int indentation) const {
     ret += " ";
   }
   ret += this->_childNodes.back()->render(guts, indentation);
-  return ret;
 }
 
 bool NodeOperator::operator== (const Node &that) const {
@@ -591,7 +1264,9 @@ bool NodeOperator::operator== (const Node &that) const {
 
 //
 // NodeConditionalExpression: true ? yes() : no()
-NodeConditionalExpression::NodeConditionalExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeConditionalExpression::NodeConditionalExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_CONDITIONAL_EXPRESSION;
+}
 Node* NodeConditionalExpression::clone(Node* node) const {
   return Node::clone(new NodeConditionalExpression());
 }
@@ -609,7 +1284,9 @@ rope_t NodeConditionalExpression::render(render_guts_t* guts, int indentation) c
 //
 // NodeParenthetical: an expression in ()'s. This is actually implicit in the AST, but we also make it an explicit
 // node. Otherwise, the renderer would have to be aware of operator precedence which would be cumbersome.
-NodeParenthetical::NodeParenthetical(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeParenthetical::NodeParenthetical(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_PARENTHETICAL;
+}
 Node* NodeParenthetical::clone(Node* node) const {
   return Node::clone(new NodeParenthetical());
 }
@@ -628,7 +1305,9 @@ bool NodeParenthetical::compare(bool val) const {
 
 //
 // NodeAssignment: identifier = expression
-NodeAssignment::NodeAssignment(node_assignment_t op, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), op(op) {}
+NodeAssignment::NodeAssignment(node_assignment_t op, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), op(op) {
+  this->_kind = NODE_ASSIGNMENT;
+}
 
 Node* NodeAssignment::clone(Node* node) const {
   return Node::clone(new NodeAssignment(this->op));
@@ -702,7 +1381,9 @@ bool NodeAssignment::operator== (const Node &that) const {
 
 //
 // NodeUnary
-NodeUnary::NodeUnary(node_unary_t op, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), op(op) {}
+NodeUnary::NodeUnary(node_unary_t op, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), op(op) {
+  this->_kind = NODE_UNARY;
+}
 
 Node* NodeUnary::clone(Node* node) const {
   return Node::clone(new NodeUnary(this->op));
@@ -756,7 +1437,9 @@ bool NodeUnary::operator== (const Node &that) const {
 
 //
 // NodePostfix
-NodePostfix::NodePostfix(node_postfix_t op, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), op(op) {}
+NodePostfix::NodePostfix(node_postfix_t op, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), op(op) {
+  this->_kind = NODE_POSTFIX;
+}
 
 Node* NodePostfix::clone(Node* node) const {
   return Node::clone(new NodePostfix(this->op));
@@ -781,7 +1464,9 @@ bool NodePostfix::operator== (const Node &that) const {
 
 //
 // NodeIdentifier
-NodeIdentifier::NodeIdentifier(const string &name, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), _name(name) {}
+NodeIdentifier::NodeIdentifier(const string &name, const unsigned int lineno /* = 0 */) : NodeExpression(lineno), _name(name) {
+  this->_kind = NODE_IDENTIFIER;
+}
 
 Node* NodeIdentifier::clone(Node* node) const {
   return Node::clone(new NodeIdentifier(this->_name));
@@ -800,7 +1485,15 @@ bool NodeIdentifier::isValidlVal() const {
 }
 
 void NodeIdentifier::rename(const string &str) {
-  this->_name = str;
+  if (this->_name != str) {
+    this->_name = str;
+    this->markDirty();
+
+    // Renaming may happen on several threads at once, see markDirty()
+    if (this->_index != NULL) {
+      __atomic_store_n(&this->_index->_bindingsChanged, true, __ATOMIC_RELAXED);
+    }
+  }
 }
 
 bool NodeIdentifier::operator== (const Node &that) const {
@@ -810,7 +1503,9 @@ bool NodeIdentifier::operator== (const Node &that) const {
 
 //
 // NodeArgList: list of expressions for a function call or definition
-NodeArgList::NodeArgList(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeArgList::NodeArgList(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_ARG_LIST;
+}
 Node* NodeArgList::clone(Node* node) const {
   return Node::clone(new NodeArgList());
 }
@@ -821,7 +1516,9 @@ rope_t NodeArgList::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeFunctionDeclaration: brings a function into scope
-NodeFunctionDeclaration::NodeFunctionDeclaration(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeFunctionDeclaration::NodeFunctionDeclaration(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_FUNCTION_DECLARATION;
+}
 
 Node* NodeFunctionDeclaration::clone(Node* node) const {
   return Node::clone(new NodeFunctionDeclaration());
@@ -839,7 +1536,9 @@ rope_t NodeFunctionDeclaration::render(render_guts_t* guts, int indentation) con
 
 //
 // NodeFunctionExpression: returns a function
-NodeFunctionExpression::NodeFunctionExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeFunctionExpression::NodeFunctionExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_FUNCTION_EXPRESSION;
+}
 
 Node* NodeFunctionExpression::clone(Node* node) const {
   return Node::clone(new NodeFunctionExpression());
@@ -860,7 +1559,9 @@ rope_t NodeFunctionExpression::render(render_guts_t* guts, int indentation) cons
 
 //
 // NodeFunctionCall: foo(1). note: this does not cover new foo(1);
-NodeFunctionCall::NodeFunctionCall(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeFunctionCall::NodeFunctionCall(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_FUNCTION_CALL;
+}
 Node* NodeFunctionCall::clone(Node* node) const {
   return Node::clone(new NodeFunctionCall());
 }
@@ -871,7 +1572,9 @@ rope_t NodeFunctionCall::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeFunctionConstructor: new foo(1)
-NodeFunctionConstructor::NodeFunctionConstructor(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeFunctionConstructor::NodeFunctionConstructor(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_FUNCTION_CONSTRUCTOR;
+}
 Node* NodeFunctionConstructor::clone(Node* node) const {
   return Node::clone(new NodeFunctionConstructor());
 }
@@ -882,7 +1585,9 @@ rope_t NodeFunctionConstructor::render(render_guts_t* guts, int indentation) con
 
 //
 // NodeIf: if (true) { honk(dazzle); };
-NodeIf::NodeIf(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeIf::NodeIf(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_IF;
+}
 Node* NodeIf::clone(Node* node) const {
   return Node::clone(new NodeIf());
 }
@@ -929,7 +1634,9 @@ rope_t NodeIf::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeWith: with (foo) { bar(); };
-NodeWith::NodeWith(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeWith::NodeWith(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_WITH;
+}
 Node* NodeWith::clone(Node* node) const {
   return Node::clone(new NodeWith());
 }
@@ -946,7 +1653,9 @@ rope_t NodeWith::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeTry
-NodeTry::NodeTry(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeTry::NodeTry(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_TRY;
+}
 Node* NodeTry::clone(Node* node) const {
   return Node::clone(new NodeTry());
 }
@@ -972,7 +1681,9 @@ rope_t NodeTry::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeStatement
-NodeStatement::NodeStatement(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeStatement::NodeStatement(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_STATEMENT;
+}
 rope_t NodeStatement::renderStatement(render_guts_t* guts, int indentation) const {
   return this->render(guts, indentation) + ";";
 }
@@ -980,7 +1691,9 @@ rope_t NodeStatement::renderStatement(render_guts_t* guts, int indentation) cons
 //
 // NodeStatementWithExpression: generalized node for return, throw, continue, and break. makes rendering easier and
 // the rewriter doesn't really need anything from the nodes
-NodeStatementWithExpression::NodeStatementWithExpression(node_statement_with_expression_t statement, const unsigned int lineno /* = 0 */) : NodeStatement(lineno), statement(statement) {}
+NodeStatementWithExpression::NodeStatementWithExpression(node_statement_with_expression_t statement, const unsigned int lineno /* = 0 */) : NodeStatement(lineno), statement(statement) {
+  this->_kind = NODE_STATEMENT_WITH_EXPRESSION;
+}
 
 Node* NodeStatementWithExpression::clone(Node* node) const {
   return Node::clone(new NodeStatementWithExpression(this->statement));
@@ -1018,7 +1731,9 @@ bool NodeStatementWithExpression::operator== (const Node &that) const {
 
 //
 // NodeLabel
-NodeLabel::NodeLabel(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeLabel::NodeLabel(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_LABEL;
+}
 Node* NodeLabel::clone(Node* node) const {
   return Node::clone(new NodeLabel());
 }
@@ -1033,7 +1748,9 @@ rope_t NodeLabel::renderStatement(render_guts_t* guts, int indentation) const {
 
 //
 // NodeSwitch
-NodeSwitch::NodeSwitch(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeSwitch::NodeSwitch(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_SWITCH;
+}
 Node* NodeSwitch::clone(Node* node) const {
   return Node::clone(new NodeSwitch());
 }
@@ -1046,7 +1763,9 @@ rope_t NodeSwitch::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeCaseClause: case: bar();
-NodeCaseClause::NodeCaseClause(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeCaseClause::NodeCaseClause(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_CASE_CLAUSE;
+}
 Node* NodeCaseClause::clone(Node* node) const {
   return Node::clone(new NodeCaseClause());
 }
@@ -1065,7 +1784,9 @@ rope_t NodeCaseClause::renderIndentedStatement(render_guts_t* guts, int indentat
 
 //
 // NodeDefaultClause: default: foo();
-NodeDefaultClause::NodeDefaultClause(const unsigned int lineno /* = 0 */) : NodeCaseClause(lineno) {}
+NodeDefaultClause::NodeDefaultClause(const unsigned int lineno /* = 0 */) : NodeCaseClause(lineno) {
+  this->_kind = NODE_DEFAULT_CLAUSE;
+}
 Node* NodeDefaultClause::clone(Node* node) const {
   return Node::clone(new NodeDefaultClause());
 }
@@ -1076,7 +1797,9 @@ rope_t NodeDefaultClause::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeVarDeclaration: a list of identifiers with optional assignments
-NodeVarDeclaration::NodeVarDeclaration(bool iterator /* = false */, const unsigned int lineno /* = 0 */) : NodeStatement(lineno), _iterator(iterator) {}
+NodeVarDeclaration::NodeVarDeclaration(bool iterator /* = false */, const unsigned int lineno /* = 0 */) : NodeStatement(lineno), _iterator(iterator) {
+  this->_kind = NODE_VAR_DECLARATION;
+}
 Node* NodeVarDeclaration::clone(Node* node) const {
   return Node::clone(new NodeVarDeclaration());
 }
@@ -1091,12 +1814,15 @@ bool NodeVarDeclaration::iterator() const {
 
 Node* NodeVarDeclaration::setIterator(bool iterator) {
   this->_iterator = iterator;
+  this->markDirty();
   return this;
 }
 
 //
 // NodeTypehint: a variable declaration with a typehint
-NodeTypehint::NodeTypehint(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeTypehint::NodeTypehint(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_TYPEHINT;
+}
 Node* NodeTypehint::clone(Node* node) const {
   return Node::clone(new NodeTypehint());
 }
@@ -1110,18 +1836,62 @@ rope_t NodeTypehint::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeObjectLiteral
-NodeObjectLiteral::NodeObjectLiteral(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeObjectLiteral::NodeObjectLiteral(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_OBJECT_LITERAL;
+}
 Node* NodeObjectLiteral::clone(Node* node) const {
   return Node::clone(new NodeObjectLiteral());
 }
 
 rope_t NodeObjectLiteral::render(render_guts_t* guts, int indentation) const {
+  if (guts->source != NULL) {
+    return this->renderVerbatim(guts, indentation);
+  }
   return rope_t("{") + this->renderImplodeChildren(guts, indentation, guts->pretty ? ", " : ",") + "}";
 }
 
+rope_t NodeObjectLiteral::renderVerbatim(render_guts_t* guts, int indentation) const {
+
+  // Same idea as NodeStatementList::renderVerbatim() except properties are
+  // separated by commas, and the braces are part of this node's range.
+  const string& source = *guts->source;
+  if (this->sourceClean()) {
+    return rope_t(source.data() + this->_sourceBegin, this->_sourceEnd - this->_sourceBegin);
+  }
+  rope_t ret("{");
+  int prev_end = this->hasSourceRange() ? this->_sourceBegin + 1 : -1;
+  bool first = true;
+  for (node_list_t::const_iterator ii = this->_childNodes.begin(); ii != this->_childNodes.end(); ++ii) {
+    const Node* node = *ii;
+    if (node->hasSourceRange() && prev_end >= 0 && prev_end <= node->sourceBegin() &&
+        isSourceTrivia(source, prev_end, node->sourceBegin(), first ? ' ' : ',')) {
+      ret += rope_t(source.data() + prev_end, node->sourceBegin() - prev_end);
+    } else if (!first) {
+      ret += guts->pretty ? ", " : ",";
+    }
+    if (node->sourceClean()) {
+      ret += rope_t(source.data() + node->sourceBegin(), node->sourceEnd() - node->sourceBegin());
+    } else {
+      ret += node->render(guts, sourceIndentationLevel(source, node, indentation));
+    }
+
+    // A gap can only be reused if it still sits between the same two
+    // properties, otherwise the comma could get lost.
+    prev_end = node->hasSourceRange() ? node->sourceEnd() : -1;
+    first = false;
+  }
+  if (prev_end >= 0 && isSourceTrivia(source, prev_end, this->_sourceEnd - 1, ',')) {
+    ret += rope_t(source.data() + prev_end, this->_sourceEnd - 1 - prev_end);
+  }
+  ret += "}";
+  return ret;
+}
+
 //
 // NodeObjectLiteralProperty
-NodeObjectLiteralProperty::NodeObjectLiteralProperty(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeObjectLiteralProperty::NodeObjectLiteralProperty(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_OBJECT_LITERAL_PROPERTY;
+}
 Node* NodeObjectLiteralProperty::clone(Node* node) const {
   return Node::clone(new NodeObjectLiteralProperty());
 }
@@ -1133,7 +1903,9 @@ rope_t NodeObjectLiteralProperty::render(render_guts_t* guts, int indentation) c
 
 //
 // NodeArrayLiteral
-NodeArrayLiteral::NodeArrayLiteral(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeArrayLiteral::NodeArrayLiteral(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_ARRAY_LITERAL;
+}
 Node* NodeArrayLiteral::clone(Node* node) const {
   return Node::clone(new NodeArrayLiteral());
 }
@@ -1144,7 +1916,9 @@ rope_t NodeArrayLiteral::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeStaticMemberExpression: object access via foo.bar
-NodeStaticMemberExpression::NodeStaticMemberExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeStaticMemberExpression::NodeStaticMemberExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_STATIC_MEMBER_EXPRESSION;
+}
 rope_t NodeStaticMemberExpression::render(render_guts_t* guts, int indentation) const {
   return rope_t(this->_childNodes.front()->render(guts, indentation)) + "." + this->_childNodes.back()->render(guts, indentation);
 }
@@ -1159,7 +1933,9 @@ bool NodeStaticMemberExpression::isValidlVal() const {
 
 //
 // NodeDynamicMemberExpression: object access via foo['bar']
-NodeDynamicMemberExpression::NodeDynamicMemberExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeDynamicMemberExpression::NodeDynamicMemberExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_DYNAMIC_MEMBER_EXPRESSION;
+}
 
 Node* NodeDynamicMemberExpression::clone(Node* node) const {
   return Node::clone(new NodeDynamicMemberExpression());
@@ -1176,7 +1952,9 @@ bool NodeDynamicMemberExpression::isValidlVal() const {
 
 //
 // NodeForLoop: only for(;;); loops, not for in
-NodeForLoop::NodeForLoop(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeForLoop::NodeForLoop(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_FOR_LOOP;
+}
 Node* NodeForLoop::clone(Node* node) const {
   return Node::clone(new NodeForLoop());
 }
@@ -1193,7 +1971,9 @@ rope_t NodeForLoop::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeForIn
-NodeForIn::NodeForIn(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeForIn::NodeForIn(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_FOR_IN;
+}
 Node* NodeForIn::clone(Node* node) const {
   return Node::clone(new NodeForIn());
 }
@@ -1209,7 +1989,9 @@ rope_t NodeForIn::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeForEachIn
-NodeForEachIn::NodeForEachIn(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeForEachIn::NodeForEachIn(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_FOR_EACH_IN;
+}
 Node* NodeForEachIn::clone(Node* node) const {
   return Node::clone(new NodeForEachIn());
 }
@@ -1225,7 +2007,9 @@ rope_t NodeForEachIn::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeWhile
-NodeWhile::NodeWhile(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeWhile::NodeWhile(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_WHILE;
+}
 Node* NodeWhile::clone(Node* node) const {
   return Node::clone(new NodeWhile());
 }
@@ -1238,7 +2022,9 @@ rope_t NodeWhile::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeDoWhile
-NodeDoWhile::NodeDoWhile(const unsigned int lineno /* = 0 */) : NodeStatement(lineno) {}
+NodeDoWhile::NodeDoWhile(const unsigned int lineno /* = 0 */) : NodeStatement(lineno) {
+  this->_kind = NODE_DO_WHILE;
+}
 Node* NodeDoWhile::clone(Node* node) const {
   return Node::clone(new NodeDoWhile());
 }
@@ -1257,7 +2043,9 @@ rope_t NodeDoWhile::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeXMLDefaultNamespace
-NodeXMLDefaultNamespace::NodeXMLDefaultNamespace(const unsigned int lineno /* = 0 */) : NodeStatement(lineno) {}
+NodeXMLDefaultNamespace::NodeXMLDefaultNamespace(const unsigned int lineno /* = 0 */) : NodeStatement(lineno) {
+  this->_kind = NODE_XML_DEFAULT_NAMESPACE;
+}
 
 Node* NodeXMLDefaultNamespace::clone(Node* node) const {
   return Node::clone(new NodeXMLDefaultNamespace());
@@ -1269,7 +2057,9 @@ rope_t NodeXMLDefaultNamespace::render(render_guts_t* guts, int indentation) con
 
 //
 // NodeXMLName
-NodeXMLName::NodeXMLName(const string &ns, const string &name, const unsigned int lineno /* = 0 */) : Node(lineno), _ns(ns), _name(name) {}
+NodeXMLName::NodeXMLName(const string &ns, const string &name, const unsigned int lineno /* = 0 */) : Node(lineno), _ns(ns), _name(name) {
+  this->_kind = NODE_XML_NAME;
+}
 
 Node* NodeXMLName::clone(Node* node) const {
   return Node::clone(new NodeXMLName(this->_ns, this->_name));
@@ -1293,7 +2083,9 @@ const string NodeXMLName::name() const {
 
 //
 // NodeXMLElement
-NodeXMLElement::NodeXMLElement(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeXMLElement::NodeXMLElement(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_XML_ELEMENT;
+}
 
 Node* NodeXMLElement::clone(Node* node) const {
   return Node::clone(new NodeXMLElement());
@@ -1338,7 +2130,9 @@ rope_t NodeXMLElement::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeXMLComment
-NodeXMLComment::NodeXMLComment(const string &comment, const unsigned int lineno /* = 0 */) : Node(lineno), _comment(comment) {}
+NodeXMLComment::NodeXMLComment(const string &comment, const unsigned int lineno /* = 0 */) : Node(lineno), _comment(comment) {
+  this->_kind = NODE_XML_COMMENT;
+}
 
 Node* NodeXMLComment::clone(Node* node) const {
   return Node::clone(new NodeXMLComment(this->_comment));
@@ -1357,7 +2151,9 @@ const string NodeXMLComment::comment() const {
 
 //
 // NodeXMLPI
-NodeXMLPI::NodeXMLPI(const string &data, const unsigned int lineno /* = 0 */) : Node(lineno), _data(data) {}
+NodeXMLPI::NodeXMLPI(const string &data, const unsigned int lineno /* = 0 */) : Node(lineno), _data(data) {
+  this->_kind = NODE_XML_P_I;
+}
 
 Node* NodeXMLPI::clone(Node* node) const {
   return Node::clone(new NodeXMLPI(this->_data));
@@ -1376,7 +2172,9 @@ const string NodeXMLPI::data() const {
 
 //
 // NodeXMLContentList
-NodeXMLContentList::NodeXMLContentList(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeXMLContentList::NodeXMLContentList(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_XML_CONTENT_LIST;
+}
 
 Node* NodeXMLContentList::clone(Node* node) const {
   return Node::clone(new NodeXMLContentList());
@@ -1388,7 +2186,9 @@ rope_t NodeXMLContentList::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeXMLTextData
-NodeXMLTextData::NodeXMLTextData(const unsigned int lineno /* = 0 */) : Node(lineno), whitespace(true) {}
+NodeXMLTextData::NodeXMLTextData(const unsigned int lineno /* = 0 */) : Node(lineno), whitespace(true) {
+  this->_kind = NODE_XML_TEXT_DATA;
+}
 
 Node* NodeXMLTextData::clone(Node* node) const {
   NodeXMLTextData* new_node = new NodeXMLTextData();
@@ -1405,6 +2205,7 @@ void NodeXMLTextData::appendData(rope_t str, bool isWhitespace /* = false */) {
   if (!isWhitespace) {
     this->whitespace = false;
   }
+  this->markDirty();
 }
 
 bool NodeXMLTextData::isWhitespace() const {
@@ -1417,7 +2218,9 @@ const char* NodeXMLTextData::data() const {
 
 //
 // NodeXMLEmbeddedExpression
-NodeXMLEmbeddedExpression::NodeXMLEmbeddedExpression(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeXMLEmbeddedExpression::NodeXMLEmbeddedExpression(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_XML_EMBEDDED_EXPRESSION;
+}
 
 Node* NodeXMLEmbeddedExpression::clone(Node* node) const {
   return Node::clone(new NodeXMLEmbeddedExpression());
@@ -1429,7 +2232,9 @@ rope_t NodeXMLEmbeddedExpression::render(render_guts_t* guts, int indentation) c
 
 //
 // NodeXMLAttributeList
-NodeXMLAttributeList::NodeXMLAttributeList(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeXMLAttributeList::NodeXMLAttributeList(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_XML_ATTRIBUTE_LIST;
+}
 
 Node* NodeXMLAttributeList::clone(Node* node) const {
   return Node::clone(new NodeXMLAttributeList());
@@ -1441,7 +2246,9 @@ rope_t NodeXMLAttributeList::render(render_guts_t* guts, int indentation) const
 
 //
 // NodeXMLAttribute
-NodeXMLAttribute::NodeXMLAttribute(const unsigned int lineno /* = 0 */) : Node(lineno) {}
+NodeXMLAttribute::NodeXMLAttribute(const unsigned int lineno /* = 0 */) : Node(lineno) {
+  this->_kind = NODE_XML_ATTRIBUTE;
+}
 
 Node* NodeXMLAttribute::clone(Node* node) const {
   return Node::clone(new NodeXMLAttribute());
@@ -1464,7 +2271,9 @@ rope_t NodeXMLAttribute::render(render_guts_t* guts, int indentation) const {
 
 //
 // NodeWildcardIdentifier
-NodeWildcardIdentifier::NodeWildcardIdentifier(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeWildcardIdentifier::NodeWildcardIdentifier(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_WILDCARD_IDENTIFIER;
+}
 
 Node* NodeWildcardIdentifier::clone(Node* node) const {
   return Node::clone(new NodeWildcardIdentifier());
@@ -1480,7 +2289,9 @@ bool NodeWildcardIdentifier::isValidlVal() const {
 
 //
 // NodeStaticAttributeIdentifier
-NodeStaticAttributeIdentifier::NodeStaticAttributeIdentifier(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeStaticAttributeIdentifier::NodeStaticAttributeIdentifier(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_STATIC_ATTRIBUTE_IDENTIFIER;
+}
 
 Node* NodeStaticAttributeIdentifier::clone(Node* node) const {
   return Node::clone(new NodeStaticAttributeIdentifier());
@@ -1496,7 +2307,9 @@ bool NodeStaticAttributeIdentifier::isValidlVal() const {
 
 //
 // NodeDynamicAttributeIdentifier
-NodeDynamicAttributeIdentifier::NodeDynamicAttributeIdentifier(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeDynamicAttributeIdentifier::NodeDynamicAttributeIdentifier(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_DYNAMIC_ATTRIBUTE_IDENTIFIER;
+}
 
 Node* NodeDynamicAttributeIdentifier::clone(Node* node) const {
   return Node::clone(new NodeDynamicAttributeIdentifier());
@@ -1512,7 +2325,9 @@ bool NodeDynamicAttributeIdentifier::isValidlVal() const {
 
 //
 // NodeStaticQualifiedIdentifier
-NodeStaticQualifiedIdentifier::NodeStaticQualifiedIdentifier(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeStaticQualifiedIdentifier::NodeStaticQualifiedIdentifier(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_STATIC_QUALIFIED_IDENTIFIER;
+}
 
 Node* NodeStaticQualifiedIdentifier::clone(Node* node) const {
   return Node::clone(new NodeStaticQualifiedIdentifier());
@@ -1530,7 +2345,9 @@ bool NodeStaticQualifiedIdentifier::isValidlVal() const {
 
 //
 // NodeDynamicQualifiedIdentifier
-NodeDynamicQualifiedIdentifier::NodeDynamicQualifiedIdentifier(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeDynamicQualifiedIdentifier::NodeDynamicQualifiedIdentifier(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_DYNAMIC_QUALIFIED_IDENTIFIER;
+}
 
 Node* NodeDynamicQualifiedIdentifier::clone(Node* node) const {
   return Node::clone(new NodeDynamicQualifiedIdentifier());
@@ -1548,7 +2365,9 @@ bool NodeDynamicQualifiedIdentifier::isValidlVal() const {
 
 //
 // NodeFilteringPredicate
-NodeFilteringPredicate::NodeFilteringPredicate(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeFilteringPredicate::NodeFilteringPredicate(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_FILTERING_PREDICATE;
+}
 
 Node* NodeFilteringPredicate::clone(Node* node) const {
   return Node::clone(new NodeFilteringPredicate());
@@ -1566,7 +2385,9 @@ bool NodeFilteringPredicate::isValidlVal() const {
 
 //
 // NodeDescendantExpression
-NodeDescendantExpression::NodeDescendantExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {}
+NodeDescendantExpression::NodeDescendantExpression(const unsigned int lineno /* = 0 */) : NodeExpression(lineno) {
+  this->_kind = NODE_DESCENDANT_EXPRESSION;
+}
 
 rope_t NodeDescendantExpression::render(render_guts_t* guts, int indentation) const {
   return rope_t(this->_childNodes.front()->render(guts, indentation)) + ".." + this->_childNodes.back()->render(guts, indentation);
@@ -25,6 +25,7 @@
 #include <sstream>
 #include <list>
 #include <memory>
+#include <vector>
 #include <ext/rope>
 
 #define NODE_WALKER_ACCEPT_DECL virtual void accept(class NodeWalker& walker)
@@ -32,22 +33,144 @@ typedef __gnu_cxx::rope<char> rope_t;
 
 namespace fbjs {
   class Node;
+  class ScopeTree;
   typedef std::list<Node*> node_list_t;
   enum node_render_enum {
     RENDER_NONE = 0,
     RENDER_PRETTY = 1,
     RENDER_MAINTAIN_LINENO = 2,
+    RENDER_CACHE = 4,
+    RENDER_PARALLEL = 8,
+    RENDER_VERBATIM = 16,
   };
   enum node_parse_enum {
     PARSE_NONE = 0,
     PARSE_TYPEHINT = 1,
     PARSE_OBJECT_LITERAL_ELISON = 2,
     PARSE_E4X = 4,
+    PARSE_INDEX = 8,
+    PARSE_SOURCE = 16, // keep a copy of the input for RENDER_VERBATIM
+  };
+
+  // Every node type along with the type walkers fall back to when they don't
+  // handle it, and its node_kind_t.
+#define FBJS_NODE_TYPES(X) \
+  X(NodeProgram, Node, NODE_PROGRAM) \
+  X(NodeStatementList, Node, NODE_STATEMENT_LIST) \
+  X(NodeExpression, Node, NODE_EXPRESSION) \
+  X(NodeNumericLiteral, NodeExpression, NODE_NUMERIC_LITERAL) \
+  X(NodeStringLiteral, NodeExpression, NODE_STRING_LITERAL) \
+  X(NodeRegexLiteral, NodeExpression, NODE_REGEX_LITERAL) \
+  X(NodeBooleanLiteral, NodeExpression, NODE_BOOLEAN_LITERAL) \
+  X(NodeNullLiteral, NodeExpression, NODE_NULL_LITERAL) \
+  X(NodeThis, NodeExpression, NODE_THIS) \
+  X(NodeEmptyExpression, NodeExpression, NODE_EMPTY_EXPRESSION) \
+  X(NodeOperator, NodeExpression, NODE_OPERATOR) \
+  X(NodeConditionalExpression, NodeExpression, NODE_CONDITIONAL_EXPRESSION) \
+  X(NodeParenthetical, NodeExpression, NODE_PARENTHETICAL) \
+  X(NodeAssignment, NodeExpression, NODE_ASSIGNMENT) \
+  X(NodeUnary, NodeExpression, NODE_UNARY) \
+  X(NodePostfix, NodeExpression, NODE_POSTFIX) \
+  X(NodeIdentifier, NodeExpression, NODE_IDENTIFIER) \
+  X(NodeFunctionCall, NodeExpression, NODE_FUNCTION_CALL) \
+  X(NodeFunctionConstructor, NodeExpression, NODE_FUNCTION_CONSTRUCTOR) \
+  X(NodeObjectLiteral, NodeExpression, NODE_OBJECT_LITERAL) \
+  X(NodeArrayLiteral, NodeExpression, NODE_ARRAY_LITERAL) \
+  X(NodeStaticMemberExpression, NodeExpression, NODE_STATIC_MEMBER_EXPRESSION) \
+  X(NodeDynamicMemberExpression, NodeExpression, NODE_DYNAMIC_MEMBER_EXPRESSION) \
+  X(NodeStatement, Node, NODE_STATEMENT) \
+  X(NodeStatementWithExpression, NodeStatement, NODE_STATEMENT_WITH_EXPRESSION) \
+  X(NodeVarDeclaration, NodeStatement, NODE_VAR_DECLARATION) \
+  X(NodeTypehint, Node, NODE_TYPEHINT) \
+  X(NodeFunctionDeclaration, Node, NODE_FUNCTION_DECLARATION) \
+  X(NodeFunctionExpression, NodeExpression, NODE_FUNCTION_EXPRESSION) \
+  X(NodeArgList, Node, NODE_ARG_LIST) \
+  X(NodeIf, Node, NODE_IF) \
+  X(NodeWith, Node, NODE_WITH) \
+  X(NodeTry, Node, NODE_TRY) \
+  X(NodeLabel, Node, NODE_LABEL) \
+  X(NodeCaseClause, Node, NODE_CASE_CLAUSE) \
+  X(NodeSwitch, Node, NODE_SWITCH) \
+  X(NodeDefaultClause, NodeCaseClause, NODE_DEFAULT_CLAUSE) \
+  X(NodeObjectLiteralProperty, Node, NODE_OBJECT_LITERAL_PROPERTY) \
+  X(NodeForLoop, Node, NODE_FOR_LOOP) \
+  X(NodeForIn, Node, NODE_FOR_IN) \
+  X(NodeForEachIn, Node, NODE_FOR_EACH_IN) \
+  X(NodeWhile, Node, NODE_WHILE) \
+  X(NodeDoWhile, NodeStatement, NODE_DO_WHILE) \
+  X(NodeXMLDefaultNamespace, NodeStatement, NODE_XML_DEFAULT_NAMESPACE) \
+  X(NodeXMLName, Node, NODE_XML_NAME) \
+  X(NodeXMLElement, NodeExpression, NODE_XML_ELEMENT) \
+  X(NodeXMLComment, Node, NODE_XML_COMMENT) \
+  X(NodeXMLPI, Node, NODE_XML_P_I) \
+  X(NodeXMLContentList, Node, NODE_XML_CONTENT_LIST) \
+  X(NodeXMLTextData, Node, NODE_XML_TEXT_DATA) \
+  X(NodeXMLEmbeddedExpression, Node, NODE_XML_EMBEDDED_EXPRESSION) \
+  X(NodeXMLAttributeList, Node, NODE_XML_ATTRIBUTE_LIST) \
+  X(NodeXMLAttribute, Node, NODE_XML_ATTRIBUTE) \
+  X(NodeWildcardIdentifier, NodeExpression, NODE_WILDCARD_IDENTIFIER) \
+  X(NodeStaticAttributeIdentifier, NodeExpression, NODE_STATIC_ATTRIBUTE_IDENTIFIER) \
+  X(NodeDynamicAttributeIdentifier, NodeExpression, NODE_DYNAMIC_ATTRIBUTE_IDENTIFIER) \
+  X(NodeStaticQualifiedIdentifier, NodeExpression, NODE_STATIC_QUALIFIED_IDENTIFIER) \
+  X(NodeDynamicQualifiedIdentifier, NodeExpression, NODE_DYNAMIC_QUALIFIED_IDENTIFIER) \
+  X(NodeFilteringPredicate, NodeExpression, NODE_FILTERING_PREDICATE) \
+  X(NodeDescendantExpression, NodeExpression, NODE_DESCENDANT_EXPRESSION)
+
+  enum node_kind_t {
+    NODE_GENERIC = 0,
+#define FBJS_NODE_KIND_ENUM(TYPE, FALLBACK, KIND) KIND,
+    FBJS_NODE_TYPES(FBJS_NODE_KIND_ENUM)
+#undef FBJS_NODE_KIND_ENUM
+    NODE_KIND_COUNT
   };
+
+  //
+  // NodeIndex: every node in a program, by kind. A program parsed with
+  // PARSE_INDEX (or after NodeProgram::buildIndex()) keeps one, and the child
+  // list methods on Node keep it current as subtrees are added and removed.
+  // Right after parsing each kind is in source order; after that, in no
+  // particular order.
+  class NodeIndex {
+    public:
+      const std::vector<Node*>& nodes(node_kind_t kind) const { return _nodes[kind]; }
+
+    protected:
+      friend class Node;
+      friend class NodeProgram;
+      friend class NodeIdentifier;
+      std::vector<Node*> _nodes[NODE_KIND_COUNT];
+
+      // Set by any edit that could change the program's ScopeTree: adding,
+      // removing or moving a declaration or an identifier, or renaming one
+      bool _bindingsChanged;
+
+      NodeIndex() : _bindingsChanged(false) {}
+      ~NodeIndex();
+      void add(Node* node);
+      void remove(Node* node);
+      void unlink(Node* node);
+  };
+
   struct render_guts_t {
     unsigned int lineno;
     bool pretty;
     bool sanelineno;
+    bool cache;
+    unsigned int threads;
+    unsigned int max_line;
+    const std::string* source;
+  };
+
+  // Memoized output of a statement along with the render state it was
+  // produced under. See Node::renderCached().
+  struct render_cache_t {
+    rope_t rope;
+    unsigned int lineno_in;
+    unsigned int lineno_out;
+    int indentation;
+    bool pretty;
+    bool sanelineno;
+    unsigned int max_line;
   };
 
   //
@@ -57,6 +180,24 @@ namespace fbjs {
       node_list_t _childNodes;
       rope_t renderImplodeChildren(render_guts_t* guts, int indentation, const char* glue) const;
       unsigned int _lineno;
+      node_kind_t _kind;
+      Node* _parent;
+      node_list_t::iterator _position;
+      mutable render_cache_t* _renderCache;
+      int _sourceBegin;
+      int _sourceEnd;
+      bool _sourceDirty;
+      unsigned char _slots;
+      unsigned int _indexSlot;
+      NodeIndex* _index;
+      void markDirty();
+      void adopt(Node* node, node_list_t::iterator position);
+      void release(Node* node, node_list_t::iterator position);
+
+    private:
+      friend class NodeIndex;
+      void cloneChildren(Node* node) const;
+      bool childNodesEqual(const Node& that) const;
 
     public:
       NODE_WALKER_ACCEPT_DECL;
@@ -65,12 +206,35 @@ namespace fbjs {
       virtual Node* clone(Node* node = NULL) const;
 
       bool empty() const;
+      node_kind_t kind() const { return _kind; }
       unsigned int lineno() const;
-      void setLineno(const unsigned int lineno) { _lineno = lineno; }
+      void setLineno(const unsigned int lineno) { _lineno = lineno; markDirty(); }
+      void setSourceRange(int begin, int end);
+      int sourceBegin() const { return _sourceBegin; }
+      int sourceEnd() const { return _sourceEnd; }
+      bool hasSourceRange() const { return _sourceEnd >= 0; }
+      bool sourceClean() const { return _sourceEnd >= 0 && !_sourceDirty; }
       virtual bool operator== (const Node&) const;
       virtual bool operator!= (const Node&) const;
 
       node_list_t& childNodes() const;
+
+      // The node whose child list this one is in, or NULL for a root or a
+      // node that has been removed.
+      Node* parent() const { return _parent; }
+
+      // Where this node sits in parent()->childNodes(). Siblings can come and
+      // go without invalidating it, so it can be passed straight to
+      // removeChild(), replaceChild() or insertBefore(). Only meaningful while
+      // parent() is set.
+      node_list_t::iterator position() const { return _position; }
+
+      // Closest function declaration or expression above this node, or NULL
+      Node* enclosingFunction() const;
+
+      // Whether this is the function being called by a call or `new`
+      bool isCallee() const;
+
       Node* appendChild(Node* node);
       Node* prependChild(Node* node);
       Node* removeChild(node_list_t::iterator node_pos);
@@ -78,11 +242,12 @@ namespace fbjs {
       Node* insertBefore(Node* node, node_list_t::iterator node_pos);
 
       rope_t render(node_render_enum opts = RENDER_NONE) const;
-      rope_t render(int opts) const;
+      rope_t render(int opts, unsigned int max_line = 0) const;
       virtual rope_t render(render_guts_t* guts, int indentation) const;
       virtual rope_t renderBlock(bool must, render_guts_t* guts, int indentation) const;
       virtual rope_t renderStatement(render_guts_t* guts, int indentation) const;
       virtual rope_t renderIndentedStatement(render_guts_t* guts, int indentation) const;
+      rope_t renderCached(render_guts_t* guts, int indentation) const;
       bool renderLinenoCatchup(render_guts_t* guts, rope_t &rope) const;
   };
 
@@ -94,7 +259,31 @@ namespace fbjs {
       NodeProgram();
       NodeProgram(const char* code, node_parse_enum opts = PARSE_NONE);
       NodeProgram(FILE* file, node_parse_enum opts = PARSE_NONE);
+      virtual ~NodeProgram();
       virtual Node* clone(Node* node = NULL) const;
+
+      // The text the program was parsed from, or "" unless it was parsed
+      // with PARSE_SOURCE. RENDER_VERBATIM copies untouched code out of it,
+      // and renders as usual without it.
+      const std::string& source() const;
+
+      // Nodes in this program by kind, or NULL unless it was parsed with
+      // PARSE_INDEX or buildIndex() has been called.
+      const NodeIndex* index() const { return _nodeIndex; }
+      void buildIndex();
+
+      // Variable scopes of this program, see scope.hpp. Built the first time
+      // they're asked for, and again after any edit that could change them.
+      // Until then the last ScopeTree returned is kept, describing the
+      // program as it was before the edit. NULL for a program without an
+      // index since it's the index that notices the edits.
+      const ScopeTree* scopes();
+
+    protected:
+      std::string _source;
+      NodeIndex* _nodeIndex;
+      ScopeTree* _scopeTree;
+      void adoptSource(std::string& source);
   };
 
   //
@@ -108,6 +297,9 @@ namespace fbjs {
       virtual rope_t renderBlock(bool must, render_guts_t* guts, int indentation) const;
       virtual rope_t renderStatement(render_guts_t* guts, int indentation) const;
       virtual rope_t renderIndentedStatement(render_guts_t* guts, int indentation) const;
+
+    protected:
+      rope_t renderVerbatim(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -229,6 +421,7 @@ namespace fbjs {
   class NodeOperator: public NodeExpression {
     protected:
       node_operator_t op;
+      void renderOperator(rope_t& ret, render_guts_t* guts, int indentation) const;
     public:
       NODE_WALKER_ACCEPT_DECL;
       NodeOperator(node_operator_t op, const unsigned int lineno = 0);
@@ -360,6 +553,9 @@ namespace fbjs {
       NodeObjectLiteral(const unsigned int lineno = 0);
       virtual Node* clone(Node* node = NULL) const;
       virtual rope_t render(render_guts_t* guts, int indentation) const;
+
+    protected:
+      rope_t renderVerbatim(render_guts_t* guts, int indentation) const;
   };
 
   //
@@ -417,6 +613,7 @@ namespace fbjs {
       NodeStatementWithExpression(node_statement_with_expression_t statement, const unsigned int lineno = 0);
       virtual Node* clone(Node* node = NULL) const;
       virtual rope_t render(render_guts_t* guts, int indentation) const;
+      const node_statement_with_expression_t statementType() const { return statement; };
       virtual bool operator== (const Node&) const;
   };
 
@@ -37,6 +37,9 @@ void* fbjs_init_parser(fbjs_parse_extra* extra) {
   extra->lineno = 1;
   extra->last_tok = 0;
   extra->last_paren_tok = 0;
+  extra->source_size = 0;
+  extra->source_base = 0;
+  extra->last_tok_end = 0;
 
   // Debug stuff
 #ifdef DEBUG_BISON
@@ -60,22 +63,41 @@ void fbjs_cleanup_parser(fbjs_parse_extra* extra, void* scanner) {
 
 //
 // Parse from a file
-NodeProgram::NodeProgram(FILE* file, node_parse_enum opts /* = PARSE_NONE */) : Node(1) {
+NodeProgram::NodeProgram(FILE* file, node_parse_enum opts /* = PARSE_NONE */) : Node(1), _nodeIndex(NULL), _scopeTree(NULL) {
+  this->_kind = NODE_PROGRAM;
+  if (opts & PARSE_INDEX) {
+    // Everything the parser builds is indexed as it's attached to the program
+    this->buildIndex();
+  }
   fbjs_parse_extra extra;
   void* scanner = fbjs_init_parser(&extra);
   extra.opts = opts;
   yyrestart(file, scanner); // read from file
   yyparse(scanner, this);
   fbjs_cleanup_parser(&extra, scanner);
+  if (opts & PARSE_SOURCE) {
+    this->adoptSource(extra.source);
+  }
 }
 
 //
 // Parser from a string
-NodeProgram::NodeProgram(const char* str, node_parse_enum opts /* = PARSE_NONE */) : Node(1) {
+NodeProgram::NodeProgram(const char* str, node_parse_enum opts /* = PARSE_NONE */) : Node(1), _nodeIndex(NULL), _scopeTree(NULL) {
+  this->_kind = NODE_PROGRAM;
+  if (opts & PARSE_INDEX) {
+    // Everything the parser builds is indexed as it's attached to the program
+    this->buildIndex();
+  }
   fbjs_parse_extra extra;
   void* scanner = fbjs_init_parser(&extra);
   extra.opts = opts;
+  if (opts & PARSE_SOURCE) {
+    extra.source = str;
+  }
   yy_scan_string(str, scanner); // read from string
   yyparse(scanner, this);
   fbjs_cleanup_parser(&extra, scanner);
+  if (opts & PARSE_SOURCE) {
+    this->adoptSource(extra.source);
+  }
 }
@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stack>
+#include <string>
 
 //#define DEBUG_FLEX
 //#define DEBUG_BISON
@@ -51,6 +52,14 @@ struct fbjs_parse_extra {
   int last_curly_tok;
   int lineno;
   fbjs::node_parse_enum opts;
+
+  // Source offsets. `source_size' counts everything read from the input file
+  // and `source_base' is the offset of the start of flex's current buffer.
+  // With PARSE_SOURCE, `source' keeps a copy of what was read.
+  std::string source;
+  int source_size;
+  int source_base;
+  int last_tok_end;
 };
 
 // Why the hell doesn't flex provide a header file?
@@ -20,6 +20,7 @@
 %{
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 
 #ifdef NOT_FBMAKE
 #include "parser.hpp"
@@ -37,7 +38,43 @@
 
 using namespace fbjs;
 
-#define YY_USER_ACTION if (yyextra->terminated) return 0;
+// Byte offset into the source of a position in flex's buffer. Nodes keep these
+// so untouched code can be copied back out verbatim, see RENDER_VERBATIM.
+#define source_offset(ptr) (yyextra->source_base + ((ptr) - YY_CURRENT_BUFFER_LVALUE->yy_ch_buf))
+
+// Whether yyinput() has run out of input. Since flex 2.5.36 it hands back 0
+// there rather than EOF, the same as for a NUL byte, but reaching the end
+// also restarts the buffer so the two can still be told apart.
+#define yyinput_eof(c) \
+  ((c) == EOF || ((c) == '\0' && YY_CURRENT_BUFFER_LVALUE->yy_buffer_status == YY_BUFFER_NEW))
+
+#define YY_USER_ACTION \
+  if (yyextra->terminated) return 0; \
+  yylloc->first_column = yylloc->last_column = source_offset(yytext);
+
+// Same as flex's default except that it remembers where in the input the
+// buffer starts, and keeps a copy of the input with PARSE_SOURCE. Whatever is
+// left unscanned at `buf' is carried over from the previous read.
+#define YY_INPUT(buf, result, max_size) \
+  yyextra->source_base = yyextra->source_size - ((buf) - YY_CURRENT_BUFFER_LVALUE->yy_ch_buf); \
+  errno = 0; \
+  while ((result = fread(buf, 1, max_size, yyin)) == 0 && ferror(yyin)) { \
+    if (errno != EINTR) { \
+      YY_FATAL_ERROR("input in flex scanner failed"); \
+      break; \
+    } \
+    errno = 0; \
+    clearerr(yyin); \
+  } \
+  yyextra->source_size += result; \
+  if (yyextra->opts & PARSE_SOURCE) { \
+    yyextra->source.append(buf, result); \
+  }
+
+// Virtual semicolons sit right after the token they follow
+#define virtual_semicolon() \
+  yylloc->first_column = yylloc->last_column = yyextra->last_tok_end; \
+  return t_VIRTUAL_SEMICOLON;
 
 #ifdef DEBUG_FLEX
 #define FBJSBEGIN(a) if(a!=YY_START) { \
@@ -106,7 +143,7 @@ XML_WHITESPACE [ \t\r]*
   \n {
     ++yylloc->first_line;
     BEGIN(IDENTIFIER);
-    return t_VIRTUAL_SEMICOLON;
+    virtual_semicolon();
   }
   . {
     BEGIN(IDENTIFIER);
@@ -119,10 +156,10 @@ XML_WHITESPACE [ \t\r]*
   "//".*    |
   {JS_WHITESPACE}+ /* om nom nom */
   "/*" {
-    char c;
+    int c;
     bool newline = false;
     for (;;) {
-      while ((c = yyinput(yyscanner)) != '*' && c != EOF) {
+      while ((c = yyinput(yyscanner)) != '*' && !yyinput_eof(c)) {
         if (c == '\n') {
           ++yylloc->first_line;
           newline = true;
@@ -137,7 +174,7 @@ XML_WHITESPACE [ \t\r]*
           newline = true;
         }
       }
-      if (c == EOF) {
+      if (yyinput_eof(c)) {
         return 0;
         break;
       }
@@ -165,7 +202,7 @@ XML_WHITESPACE [ \t\r]*
     } else {
       yyless(0);
       FBJSBEGIN(INITIAL);
-      return t_VIRTUAL_SEMICOLON;
+      virtual_semicolon();
     }
   }
   "while" {
@@ -176,7 +213,7 @@ XML_WHITESPACE [ \t\r]*
     } else {
       yyless(0);
       FBJSBEGIN(INITIAL);
-      return t_VIRTUAL_SEMICOLON;
+      virtual_semicolon();
     }
   }
   [a-zA-Z$_0-9]+ {
@@ -187,7 +224,7 @@ XML_WHITESPACE [ \t\r]*
       FBJSBEGIN(INITIAL);
     } else {
       FBJSBEGIN(INITIAL);
-      return t_VIRTUAL_SEMICOLON;
+      virtual_semicolon();
     }
   }
   \n {
@@ -277,21 +314,34 @@ XML_WHITESPACE [ \t\r]*
   }
 }
 '|\" {
+  // A NUL byte is written out as an escape, since literals are kept as C
+  // strings and the renderer uses NUL to mark where lines may be broken.
   std::string str = yytext;
-  char c;
-  while ((c = yyinput(yyscanner)) != EOF) {
+  int c;
+  for (;;) {
+    c = yyinput(yyscanner);
+    if (yyinput_eof(c)) {
+      break;
+    } else if (c == '\0') {
+      str += "\\x00";
+      continue;
+    }
     str += c;
     if (c == yytext[0]) {
       break;
     } else if (c == '\\') {
       c = yyinput(yyscanner);
-      if (c == EOF) {
+      if (yyinput_eof(c)) {
         yyless(0);
         break;
       } else if (c == '\r') {
         str.erase(--str.end());
         c = yyinput(yyscanner);
-        if (c != '\n') {
+        if (yyinput_eof(c)) {
+          break;
+        } else if (c == '\0') {
+          str += "\\x00";
+        } else if (c != '\n') {
           str += c;
           if (c == yytext[0]) {
             break;
@@ -299,9 +349,11 @@ XML_WHITESPACE [ \t\r]*
         }
       } else if (c == '\n') {
         str.erase(--str.end());
-      } else if (c == EOF) {
+      } else if (yyinput_eof(c)) {
         yyless(0);
         break;
+      } else if (c == '\0') {
+        str += "x00";
       } else {
         str += c;
       }
@@ -316,15 +368,24 @@ XML_WHITESPACE [ \t\r]*
 <IDENTIFIER>"/" FBJSBEGIN(REGEX);
 <REGEX>{
   (\[([^\]\\\n]+|\\.)+\]|\\.|[^\/\\\n])*"/"[A-Za-z]* {
-    size_t len = strlen(yytext);
+    size_t len = yyleng;
     size_t flag_pos = len - 1;
     while (yytext[flag_pos] != '/') {
       --flag_pos;
     }
-    // regex
-    yylval->string_duple[0] = (char*)malloc(flag_pos + 1);
-    memcpy(yylval->string_duple[0], yytext, flag_pos);
-    yylval->string_duple[0][flag_pos] = 0;
+    // regex, with NUL bytes escaped the same as in strings
+    std::string regex;
+    for (size_t ii = 0; ii < flag_pos; ++ii) {
+      if (yytext[ii] == '\\' && ii + 1 < flag_pos) {
+        regex += yytext[ii++];
+        regex += yytext[ii] == '\0' ? "x00" : std::string(1, yytext[ii]);
+      } else if (yytext[ii] == '\0') {
+        regex += "\\x00";
+      } else {
+        regex += yytext[ii];
+      }
+    }
+    yylval->string_duple[0] = strdup(regex.c_str());
 
     // flags
     yylval->string_duple[1] = (char*)malloc(len - flag_pos);
@@ -575,6 +636,11 @@ int parsertok_(void* guts, int tok, bool was_xml) {
       break;
   }
   }
+  if (tok == t_VIRTUAL_SEMICOLON) {
+    yylloc->first_column = yylloc->last_column = yyextra->last_tok_end;
+  } else {
+    yylloc->last_column = yyextra->last_tok_end = source_offset(yyg->yy_c_buf_p);
+  }
   yyextra->last_tok = tok;
   yyextra->last_tok_xml = was_xml;
 #ifdef DEBUG_FLEX
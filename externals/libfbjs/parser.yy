@@ -174,6 +174,7 @@ statement_list:
       // Silly hack since my awesome lexer sticks `t_VIRTUAL_SEMICOLON's all
       // over the place which ends up creating tons of `NodeEmptyExpression's
       if (dynamic_cast<NodeEmptyExpression*>($1) == NULL) {
+        $1->setSourceRange(@1.first_column, @1.last_column);
         $$ = (new NodeStatementList(yylineno))->appendChild($1);
       } else {
         delete $1;
@@ -183,6 +184,7 @@ statement_list:
 |   statement_list source_element {
       $$ = $1;
       if (dynamic_cast<NodeEmptyExpression*>($2) == NULL) {
+        $2->setSourceRange(@2.first_column, @2.last_column);
         $$->appendChild($2);
       } else {
         delete $2;
@@ -286,13 +288,16 @@ elison:
 object_literal:
     t_LCURLY t_RCURLY {
       $$ = new NodeObjectLiteral(yylineno);
+      $$->setSourceRange(@1.first_column, @2.last_column);
     }
 |   t_LCURLY property_name_and_value_list t_VIRTUAL_SEMICOLON t_RCURLY { /* note the t_VIRTUAL_SEMICOLON hack */
       $$ = $2;
+      $$->setSourceRange(@1.first_column, @4.last_column);
     }
 |   t_LCURLY property_name_and_value_list t_COMMA t_VIRTUAL_SEMICOLON t_RCURLY {
       require_support(PARSE_OBJECT_LITERAL_ELISON, "object literal elisons not supported");
       $$ = $2;
+      $$->setSourceRange(@1.first_column, @5.last_column);
     }
 
 ;
@@ -305,10 +310,14 @@ property_name:
 
 property_name_and_value_list:
     property_name t_COLON assignment_expression {
-      $$ = (new NodeObjectLiteral(yylineno))->appendChild((new NodeObjectLiteralProperty(yylineno))->appendChild($1)->appendChild($3));
+      Node* property = (new NodeObjectLiteralProperty(yylineno))->appendChild($1)->appendChild($3);
+      property->setSourceRange(@1.first_column, @3.last_column);
+      $$ = (new NodeObjectLiteral(yylineno))->appendChild(property);
     }
 |   property_name_and_value_list t_COMMA property_name t_COLON assignment_expression {
-      $$ = $1->appendChild((new NodeObjectLiteralProperty(yylineno))->appendChild($3)->appendChild($5));
+      Node* property = (new NodeObjectLiteralProperty(yylineno))->appendChild($3)->appendChild($5);
+      property->setSourceRange(@3.first_column, @5.last_column);
+      $$ = $1->appendChild(property);
     }
 ;
 
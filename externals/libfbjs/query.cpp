@@ -0,0 +1,434 @@
+#include "query.hpp"
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
+
+using namespace fbjs;
+using namespace std;
+
+//
+// Node types by name, for resolving the types in a selector
+struct query_type_t {
+  const char* name;
+  const char* fallback;
+  node_kind_t kind;
+};
+
+static const query_type_t query_types[] = {
+#define FBJS_QUERY_TYPE(TYPE, FALLBACK, KIND) { #TYPE, #FALLBACK, KIND },
+  FBJS_NODE_TYPES(FBJS_QUERY_TYPE)
+#undef FBJS_QUERY_TYPE
+};
+static const size_t query_type_count = sizeof(query_types) / sizeof(query_types[0]);
+
+// Short names for types, or pairs of types, that come up all the time
+struct query_alias_t {
+  const char* alias;
+  const char* type;
+  const char* other_type;
+};
+
+static const query_alias_t query_aliases[] = {
+  { "Call", "FunctionCall", NULL },
+  { "New", "FunctionConstructor", NULL },
+  { "String", "StringLiteral", NULL },
+  { "Number", "NumericLiteral", NULL },
+  { "Regex", "RegexLiteral", NULL },
+  { "Boolean", "BooleanLiteral", NULL },
+  { "Null", "NullLiteral", NULL },
+  { "Object", "ObjectLiteral", NULL },
+  { "Array", "ArrayLiteral", NULL },
+  { "Function", "FunctionDeclaration", "FunctionExpression" },
+  { "Member", "StaticMemberExpression", "DynamicMemberExpression" },
+};
+
+static const query_type_t* find_type(const char* name) {
+  for (size_t ii = 0; ii < query_type_count; ++ii) {
+    if (strcmp(query_types[ii].name, name) == 0) {
+      return &query_types[ii];
+    }
+  }
+  return NULL;
+}
+
+// Marks every kind whose type is `name` or derives from it. Returns false if
+// there's no such type.
+static bool add_kinds(const string& name, bool* kinds) {
+  string type = "Node" + name;
+  if (find_type(type.c_str()) == NULL) {
+    return false;
+  }
+  for (size_t ii = 0; ii < query_type_count; ++ii) {
+    for (const query_type_t* base = &query_types[ii]; base != NULL; base = find_type(base->fallback)) {
+      if (type == base->name) {
+        kinds[query_types[ii].kind] = true;
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+static bool by_lineno(const Node* left, const Node* right) {
+  return left->lineno() < right->lineno();
+}
+
+//
+// Selector
+Selector::Selector(const string& pattern) : _pattern(pattern), _pos(0) {
+  this->skipSpace();
+  this->parseStep(DESCENDANT);
+  while (true) {
+    size_t before = this->_pos;
+    this->skipSpace();
+    if (this->_pos == this->_pattern.size()) {
+      break;
+    }
+    if (this->_pattern[this->_pos] == '>') {
+      ++this->_pos;
+      this->skipSpace();
+      this->parseStep(CHILD);
+    } else if (this->_pos > before) {
+      this->parseStep(DESCENDANT);
+    } else {
+      this->error("unexpected character");
+    }
+  }
+}
+
+bool Selector::matches(const Node* node) const {
+  return node != NULL && this->matchStep(node, this->_steps.size() - 1);
+}
+
+void Selector::select(const NodeProgram* root, vector<Node*>& matches) const {
+  const step_t& last = this->_steps.back();
+  const NodeIndex* index = root->index();
+  if (index != NULL) {
+    size_t first = matches.size();
+    for (int kind = 0; kind < NODE_KIND_COUNT; ++kind) {
+      if (!last.kinds[kind]) {
+        continue;
+      }
+      const vector<Node*>& nodes = index->nodes(static_cast<node_kind_t>(kind));
+      for (vector<Node*>::const_iterator ii = nodes.begin(); ii != nodes.end(); ++ii) {
+        if (this->matchStep(*ii, this->_steps.size() - 1)) {
+          matches.push_back(*ii);
+        }
+      }
+    }
+    stable_sort(matches.begin() + first, matches.end(), by_lineno);
+    return;
+  }
+
+  vector<Node*> pending(1, const_cast<NodeProgram*>(root));
+  while (!pending.empty()) {
+    Node* node = pending.back();
+    pending.pop_back();
+    if (node == NULL) {
+      continue;
+    }
+    if (this->matchStep(node, this->_steps.size() - 1)) {
+      matches.push_back(node);
+    }
+    pending.insert(pending.end(), node->childNodes().rbegin(), node->childNodes().rend());
+  }
+}
+
+// Checks a node against one step, then the nodes above it against the steps
+// before that.
+bool Selector::matchStep(const Node* node, size_t step) const {
+  const step_t& current = this->_steps[step];
+  if (!current.kinds[node->kind()]) {
+    return false;
+  }
+  for (vector<filter_t>::const_iterator ii = current.filters.begin(); ii != current.filters.end(); ++ii) {
+    if (!this->matchFilter(node, *ii)) {
+      return false;
+    }
+  }
+  if (step == 0) {
+    return true;
+  }
+
+  const Node* parent = node->parent();
+  if (current.combinator == CHILD) {
+    return parent != NULL && this->matchStep(parent, step - 1);
+  }
+  for (; parent != NULL; parent = parent->parent()) {
+    if (this->matchStep(parent, step - 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Selector::matchFilter(const Node* node, const filter_t& filter) const {
+  const Node* parent = node->parent();
+  switch (filter.type) {
+    case FILTER_NTH: {
+      if (parent == NULL) {
+        return false;
+      }
+      node_list_t::const_iterator ii = parent->childNodes().begin();
+      for (unsigned int nth = 1; nth < filter.nth && ii != parent->childNodes().end(); ++nth) {
+        ++ii;
+      }
+      return ii != parent->childNodes().end() && *ii == node;
+    }
+
+    case FILTER_LAST:
+      return parent != NULL && parent->childNodes().back() == node;
+
+    case FILTER_CALLEE:
+      return node->isCallee();
+
+    default:
+      break;
+  }
+
+  string value;
+  if (!attribute(node, filter.attribute, value)) {
+    return false;
+  }
+  switch (filter.type) {
+    case FILTER_EQUAL:
+      return value == filter.value;
+    case FILTER_NOT_EQUAL:
+      return value != filter.value;
+    case FILTER_PREFIX:
+      return value.compare(0, filter.value.size(), filter.value) == 0;
+    case FILTER_CONTAINS:
+      return value.find(filter.value) != string::npos;
+    default:
+      return true;
+  }
+}
+
+bool Selector::attribute(const Node* node, attribute_t attribute, string& value) {
+  switch (attribute) {
+    case ATTR_NAME:
+      if (node->kind() == NODE_FUNCTION_DECLARATION || node->kind() == NODE_FUNCTION_EXPRESSION) {
+        value = dottedName(node->childNodes().front());
+      } else {
+        value = dottedName(node);
+      }
+      return !value.empty();
+
+    case ATTR_VALUE:
+      switch (node->kind()) {
+        case NODE_STRING_LITERAL:
+          value = static_cast<const NodeStringLiteral*>(node)->unquoted_value();
+          return true;
+        case NODE_NUMERIC_LITERAL:
+        case NODE_REGEX_LITERAL:
+        case NODE_BOOLEAN_LITERAL:
+        case NODE_NULL_LITERAL:
+          value = node->render(RENDER_NONE).c_str();
+          return true;
+        default:
+          return false;
+      }
+
+    case ATTR_CALLEE:
+      if (node->kind() != NODE_FUNCTION_CALL && node->kind() != NODE_FUNCTION_CONSTRUCTOR) {
+        return false;
+      }
+      value = dottedName(node->childNodes().front());
+      return !value.empty();
+  }
+  return false;
+}
+
+string Selector::dottedName(const Node* node) {
+
+  // Member expressions nest to the left, so collect the names on the way
+  // down and put them together backwards.
+  vector<const string*> names;
+  while (node != NULL && node->kind() == NODE_STATIC_MEMBER_EXPRESSION) {
+    const Node* property = node->childNodes().back();
+    if (property == NULL || property->kind() != NODE_IDENTIFIER) {
+      return "";
+    }
+    names.push_back(&static_cast<const NodeIdentifier*>(property)->name());
+    node = node->childNodes().front();
+  }
+
+  string name;
+  if (node == NULL) {
+    return "";
+  } else if (node->kind() == NODE_IDENTIFIER) {
+    name = static_cast<const NodeIdentifier*>(node)->name();
+  } else if (node->kind() == NODE_THIS) {
+    name = "this";
+  } else {
+    return "";
+  }
+  for (vector<const string*>::reverse_iterator ii = names.rbegin(); ii != names.rend(); ++ii) {
+    name += ".";
+    name += **ii;
+  }
+  return name;
+}
+
+//
+// Selector parsing
+void Selector::parseStep(combinator_t combinator) {
+  step_t step;
+  step.combinator = combinator;
+  this->parseType(step);
+  while (this->_pos < this->_pattern.size() &&
+      (this->_pattern[this->_pos] == '[' || this->_pattern[this->_pos] == ':')) {
+    this->parseFilter(step);
+  }
+  this->_steps.push_back(step);
+}
+
+void Selector::parseType(step_t& step) {
+  char next = this->_pos < this->_pattern.size() ? this->_pattern[this->_pos] : 0;
+  string name;
+  if (next == '*') {
+    ++this->_pos;
+  } else if (next != '[' && next != ':') {
+    name = this->parseWord();
+  }
+
+  bool any = name.empty() || name == "Node";
+  fill(step.kinds, step.kinds + NODE_KIND_COUNT, any);
+  if (any) {
+    return;
+  }
+  for (size_t ii = 0; ii < sizeof(query_aliases) / sizeof(query_aliases[0]); ++ii) {
+    if (name == query_aliases[ii].alias) {
+      add_kinds(query_aliases[ii].type, step.kinds);
+      if (query_aliases[ii].other_type != NULL) {
+        add_kinds(query_aliases[ii].other_type, step.kinds);
+      }
+      return;
+    }
+  }
+  if (!add_kinds(name, step.kinds)) {
+    this->error("unknown node type `" + name + "'");
+  }
+}
+
+void Selector::parseFilter(step_t& step) {
+  filter_t filter;
+  filter.nth = 0;
+  filter.attribute = ATTR_NAME;
+  if (this->_pattern[this->_pos++] == ':') {
+    string pseudo = this->parseWord();
+    if (pseudo == "first") {
+      filter.type = FILTER_NTH;
+      filter.nth = 1;
+    } else if (pseudo == "last") {
+      filter.type = FILTER_LAST;
+    } else if (pseudo == "callee") {
+      filter.type = FILTER_CALLEE;
+    } else if (pseudo == "nth") {
+      filter.type = FILTER_NTH;
+      if (this->_pos == this->_pattern.size() || this->_pattern[this->_pos] != '(') {
+        this->error("expected `(' after :nth");
+      }
+      ++this->_pos;
+      filter.nth = atoi(this->parseWord().c_str());
+      if (filter.nth == 0) {
+        this->error(":nth counts from 1");
+      }
+      if (this->_pos == this->_pattern.size() || this->_pattern[this->_pos] != ')') {
+        this->error("expected `)'");
+      }
+      ++this->_pos;
+    } else {
+      this->error("unknown pseudo-class `:" + pseudo + "'");
+    }
+    step.filters.push_back(filter);
+    return;
+  }
+
+  this->skipSpace();
+  string attribute = this->parseWord();
+  if (attribute == "name") {
+    filter.attribute = ATTR_NAME;
+  } else if (attribute == "value") {
+    filter.attribute = ATTR_VALUE;
+  } else if (attribute == "callee") {
+    filter.attribute = ATTR_CALLEE;
+  } else {
+    this->error("unknown attribute `" + attribute + "'");
+  }
+  this->skipSpace();
+
+  const char* op = this->_pattern.c_str() + this->_pos;
+  if (*op == ']') {
+    filter.type = FILTER_HAS;
+  } else {
+    if (*op == '=') {
+      filter.type = FILTER_EQUAL;
+      this->_pos += 1;
+    } else if (strncmp(op, "!=", 2) == 0) {
+      filter.type = FILTER_NOT_EQUAL;
+      this->_pos += 2;
+    } else if (strncmp(op, "^=", 2) == 0) {
+      filter.type = FILTER_PREFIX;
+      this->_pos += 2;
+    } else if (strncmp(op, "*=", 2) == 0) {
+      filter.type = FILTER_CONTAINS;
+      this->_pos += 2;
+    } else {
+      this->error("expected an operator or `]'");
+    }
+    this->skipSpace();
+    char quote = this->_pos < this->_pattern.size() ? this->_pattern[this->_pos] : 0;
+    filter.value = quote == '"' || quote == '\'' ? this->parseString() : this->parseWord();
+    this->skipSpace();
+  }
+  if (this->_pos == this->_pattern.size() || this->_pattern[this->_pos] != ']') {
+    this->error("expected `]'");
+  }
+  ++this->_pos;
+  step.filters.push_back(filter);
+}
+
+// Identifiers, dotted names and numbers
+string Selector::parseWord() {
+  size_t begin = this->_pos;
+  while (this->_pos < this->_pattern.size()) {
+    char next = this->_pattern[this->_pos];
+    if (!isalnum(next) && next != '_' && next != '$' && next != '.') {
+      break;
+    }
+    ++this->_pos;
+  }
+  if (this->_pos == begin) {
+    this->error("expected a name");
+  }
+  return this->_pattern.substr(begin, this->_pos - begin);
+}
+
+string Selector::parseString() {
+  char quote = this->_pattern[this->_pos++];
+  string value;
+  while (this->_pos < this->_pattern.size() && this->_pattern[this->_pos] != quote) {
+    if (this->_pattern[this->_pos] == '\\' && this->_pos + 1 < this->_pattern.size()) {
+      ++this->_pos;
+    }
+    value += this->_pattern[this->_pos++];
+  }
+  if (this->_pos == this->_pattern.size()) {
+    this->error("unterminated string");
+  }
+  ++this->_pos;
+  return value;
+}
+
+void Selector::skipSpace() {
+  while (this->_pos < this->_pattern.size() && isspace(this->_pattern[this->_pos])) {
+    ++this->_pos;
+  }
+}
+
+void Selector::error(const string& message) const {
+  stringstream what;
+  what << message << " at offset " << this->_pos << " in selector `" << this->_pattern << "'";
+  throw SelectorException(what.str());
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include "node.hpp"
+#include <string>
+#include <vector>
+
+namespace fbjs {
+
+  //
+  // Selector: finds nodes with a CSS-like pattern instead of a hand written
+  // walker.
+  //
+  //   Selector calls("Call[callee=\"JX.install\"] > ArgList > String:first");
+  //   std::vector<Node*> names;
+  //   calls.select(&root, names);
+  //
+  // A selector is a chain of steps separated by `>` (child of) or whitespace
+  // (descendant of). Each step is a node type followed by any number of
+  // filters:
+  //
+  //   Type        the node type without "Node", e.g. FunctionCall or
+  //               StaticMemberExpression. Base types match their subtypes, so
+  //               Expression matches every expression. * or Node matches
+  //               anything. Short names: Call, New, String, Number, Regex,
+  //               Boolean, Null, Object, Array, Function (declarations and
+  //               expressions) and Member (static and dynamic).
+  //   [attr]      the node has the attribute
+  //   [attr="x"]  the attribute is x; also != (is something else), ^= (starts
+  //               with) and *= (contains)
+  //   :first      first child of its parent; also :last and :nth(N), from 1
+  //   :callee     the function being called by a call or `new`
+  //
+  // Attributes are `name` (identifiers, dotted names like JX.Stratcom, and
+  // named functions), `value` (literals; strings without their quotes) and
+  // `callee` (the dotted name a call or `new` calls).
+  //
+  // The pattern is compiled once into an array of steps and matched right to
+  // left: only nodes of the last step's types are candidates, which come
+  // straight out of the program's index when it has one, and each candidate
+  // is checked by following parent() links up the tree.
+  class Selector {
+    public:
+      Selector(const std::string& pattern);
+
+      // Whether `node` is matched by the selector
+      bool matches(const Node* node) const;
+
+      // Appends every match in the program to `matches`, by line. Programs
+      // without an index are walked in full.
+      void select(const NodeProgram* root, std::vector<Node*>& matches) const;
+
+      // Dotted name of a node, e.g. "JX.Stratcom.listen" for the member
+      // expression, or "" if it doesn't have one. This is the selector's
+      // `name` attribute.
+      static std::string dottedName(const Node* node);
+
+    protected:
+      enum combinator_t { DESCENDANT, CHILD };
+      enum filter_enum {
+        FILTER_HAS,
+        FILTER_EQUAL,
+        FILTER_NOT_EQUAL,
+        FILTER_PREFIX,
+        FILTER_CONTAINS,
+        FILTER_NTH,
+        FILTER_LAST,
+        FILTER_CALLEE,
+      };
+      enum attribute_t { ATTR_NAME, ATTR_VALUE, ATTR_CALLEE };
+      struct filter_t {
+        filter_enum type;
+        attribute_t attribute;
+        std::string value;
+        unsigned int nth;
+      };
+      struct step_t {
+        bool kinds[NODE_KIND_COUNT];
+        std::vector<filter_t> filters;
+        combinator_t combinator; // how this step relates to the one before
+      };
+      std::vector<step_t> _steps;
+
+      bool matchStep(const Node* node, size_t step) const;
+      bool matchFilter(const Node* node, const filter_t& filter) const;
+      static bool attribute(const Node* node, attribute_t attribute, std::string& value);
+
+      // Parsing
+      std::string _pattern;
+      size_t _pos;
+      void parseStep(combinator_t combinator);
+      void parseType(step_t& step);
+      void parseFilter(step_t& step);
+      std::string parseWord();
+      std::string parseString();
+      void skipSpace();
+      void error(const std::string& message) const;
+  };
+
+  //
+  // SelectorException: thrown for a pattern that doesn't parse
+  class SelectorException: public std::runtime_error {
+    public:
+      SelectorException(const std::string& what_arg) : std::runtime_error(what_arg) {}
+  };
+}
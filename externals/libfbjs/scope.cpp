@@ -0,0 +1,452 @@
+#include "scope.hpp"
+#include <algorithm>
+
+using namespace fbjs;
+using namespace std;
+
+const atom_t AtomTable::NONE;
+const unsigned int AtomMap::NONE;
+const unsigned int ScopeTree::NONE;
+
+//
+// AtomTable
+AtomTable::AtomTable() : _slots(16, NONE) {}
+
+// FNV-1a, then linear probing from there
+size_t AtomTable::slot(const string& name) const {
+  size_t hash = 2166136261u;
+  for (size_t ii = 0; ii < name.size(); ++ii) {
+    hash = (hash ^ (unsigned char)name[ii]) * 16777619u;
+  }
+  size_t mask = this->_slots.size() - 1;
+  size_t ii = hash & mask;
+  while (this->_slots[ii] != NONE && this->_names[this->_slots[ii]] != name) {
+    ii = (ii + 1) & mask;
+  }
+  return ii;
+}
+
+atom_t AtomTable::intern(const string& name) {
+  size_t ii = this->slot(name);
+  if (this->_slots[ii] != NONE) {
+    return this->_slots[ii];
+  }
+  atom_t atom = this->_names.size();
+  this->_names.push_back(name);
+  this->_slots[ii] = atom;
+
+  // Kept at most half full so probes stay short
+  if (this->_names.size() * 2 > this->_slots.size()) {
+    vector<atom_t>(this->_slots.size() * 2, NONE).swap(this->_slots);
+    for (atom_t ii = 0; ii < this->_names.size(); ++ii) {
+      this->_slots[this->slot(this->_names[ii])] = ii;
+    }
+  }
+  return atom;
+}
+
+atom_t AtomTable::find(const string& name) const {
+  return this->_slots[this->slot(name)];
+}
+
+//
+// AtomMap
+AtomMap::AtomMap() : _slots(4, make_pair(AtomTable::NONE, NONE)), _size(0) {}
+
+size_t AtomMap::slot(atom_t atom) const {
+  size_t mask = this->_slots.size() - 1;
+  size_t ii = (atom * 2654435761u) & mask;
+  while (this->_slots[ii].first != AtomTable::NONE && this->_slots[ii].first != atom) {
+    ii = (ii + 1) & mask;
+  }
+  return ii;
+}
+
+unsigned int AtomMap::find(atom_t atom) const {
+  return this->_slots[this->slot(atom)].second;
+}
+
+void AtomMap::set(atom_t atom, unsigned int value) {
+  size_t ii = this->slot(atom);
+  if (this->_slots[ii].first == AtomTable::NONE) {
+    if ((this->_size + 1) * 2 > this->_slots.size()) {
+      vector<pair<atom_t, unsigned int> > slots(this->_slots.size() * 2, make_pair(AtomTable::NONE, NONE));
+      slots.swap(this->_slots);
+      for (size_t jj = 0; jj < slots.size(); ++jj) {
+        if (slots[jj].first != AtomTable::NONE) {
+          this->_slots[this->slot(slots[jj].first)] = slots[jj];
+        }
+      }
+      ii = this->slot(atom);
+    }
+    ++this->_size;
+  }
+  this->_slots[ii] = make_pair(atom, value);
+}
+
+//
+// ScopeTree
+
+// The identifier a var, parameter or catch clause declares. It may be wrapped
+// in an initializer or a typehint.
+static NodeIdentifier* declared_identifier(Node* node) {
+  if (node == NULL) {
+    return NULL;
+  }
+  if (node->kind() == NODE_IDENTIFIER) {
+    return static_cast<NodeIdentifier*>(node);
+  }
+  Node* first = node->childNodes().empty() ? NULL : node->childNodes().front();
+  if (first != NULL && first->kind() == NODE_IDENTIFIER) {
+    return static_cast<NodeIdentifier*>(first);
+  }
+  return NULL;
+}
+
+static bool is_eval_call(const Node* node) {
+  Node* callee = node->childNodes().front();
+  return callee != NULL && callee->kind() == NODE_IDENTIFIER &&
+    static_cast<NodeIdentifier*>(callee)->name() == "eval";
+}
+
+ScopeTree::ScopeTree(Node* root) {
+  this->addScope(SCOPE_GLOBAL, root, NONE);
+  this->declareScopes(root);
+  this->propagateFlags();
+  sort(this->_scopeNodes.begin(), this->_scopeNodes.end());
+  this->resolveScopes(root);
+  sort(this->_resolved.begin(), this->_resolved.end());
+}
+
+unsigned int ScopeTree::addScope(scope_enum type, Node* node, unsigned int parent) {
+  unsigned int scope = this->_scopes.size();
+  this->_scopes.push_back(scope_t());
+  scope_t& added = this->_scopes.back();
+  added.type = type;
+  added.node = node;
+  added.parent = parent;
+  added.has_with = false;
+  added.has_eval = false;
+  added.contains_with = false;
+  added.contains_eval = false;
+  if (parent != NONE) {
+    this->_scopes[parent].children.push_back(scope);
+  }
+  this->_scopeNodes.push_back(make_pair(node, scope));
+  return scope;
+}
+
+// Declaring a name twice in one scope gives back the binding it already has
+unsigned int ScopeTree::declare(unsigned int scope, binding_enum type, NodeIdentifier* identifier) {
+  atom_t name = this->_atoms.intern(identifier->name());
+  unsigned int binding = this->_scopes[scope].names.find(name);
+  if (binding != AtomMap::NONE) {
+    return binding;
+  }
+  binding = this->_bindings.size();
+  this->_bindings.push_back(binding_t());
+  binding_t& added = this->_bindings.back();
+  added.name = name;
+  added.type = type;
+  added.scope = scope;
+  added.declaration = identifier;
+  this->_scopes[scope].bindings.push_back(binding);
+  this->_scopes[scope].names.set(name, binding);
+  return binding;
+}
+
+// First pass: finds every scope and what's declared in it. Both passes walk
+// the tree off an explicit stack since expressions can nest arbitrarily deep.
+void ScopeTree::declareScopes(Node* root) {
+  vector<pair<Node*, unsigned int> > pending(1, make_pair(root, 0u));
+  vector<pair<Node*, unsigned int> > named_expressions;
+  while (!pending.empty()) {
+    Node* node = pending.back().first;
+    unsigned int scope = pending.back().second;
+    pending.pop_back();
+    if (node == NULL) {
+      continue;
+    }
+
+    // Function and var declarations belong to the closest function, past any
+    // catch clauses in the way
+    unsigned int function = scope;
+    while (this->_scopes[function].type == SCOPE_CATCH) {
+      function = this->_scopes[function].parent;
+    }
+
+    switch (node->kind()) {
+      case NODE_FUNCTION_DECLARATION:
+      case NODE_FUNCTION_EXPRESSION: {
+        // name, arguments, body
+        node_list_t::iterator ii = node->childNodes().begin();
+        NodeIdentifier* name = declared_identifier(*ii);
+        Node* args = *++ii;
+        Node* body = *++ii;
+        if (name != NULL && node->kind() == NODE_FUNCTION_DECLARATION) {
+          this->declare(function, BINDING_FUNCTION, name);
+        }
+        unsigned int inner = this->addScope(SCOPE_FUNCTION, node, scope);
+        if (name != NULL && node->kind() == NODE_FUNCTION_EXPRESSION) {
+          named_expressions.push_back(make_pair(name, inner));
+        }
+        for (node_list_t::iterator arg = args->childNodes().begin(); arg != args->childNodes().end(); ++arg) {
+          NodeIdentifier* param = declared_identifier(*arg);
+          if (param != NULL) {
+            this->declare(inner, BINDING_PARAM, param);
+          }
+        }
+        pending.push_back(make_pair(body, inner));
+        continue;
+      }
+
+      case NODE_VAR_DECLARATION:
+        for (node_list_t::iterator ii = node->childNodes().begin(); ii != node->childNodes().end(); ++ii) {
+          NodeIdentifier* var = declared_identifier(*ii);
+          if (var != NULL) {
+            this->declare(function, BINDING_VAR, var);
+          }
+        }
+        break;
+
+      case NODE_TRY: {
+        // try block, catch variable, catch block, finally block
+        node_list_t::iterator ii = node->childNodes().begin();
+        Node* block = *ii;
+        NodeIdentifier* var = declared_identifier(*++ii);
+        Node* catch_block = *++ii;
+        Node* finally_block = *++ii;
+        if (var != NULL) {
+          unsigned int inner = this->addScope(SCOPE_CATCH, node, scope);
+          this->declare(inner, BINDING_CATCH, var);
+          pending.push_back(make_pair(finally_block, scope));
+          pending.push_back(make_pair(catch_block, inner));
+          pending.push_back(make_pair(block, scope));
+          continue;
+        }
+        break;
+      }
+
+      case NODE_WITH:
+        this->_scopes[scope].has_with = true;
+        break;
+
+      case NODE_FUNCTION_CALL:
+        if (is_eval_call(node)) {
+          this->_scopes[scope].has_eval = true;
+        }
+        break;
+
+      default:
+        break;
+    }
+    for (node_list_t::reverse_iterator ii = node->childNodes().rbegin(); ii != node->childNodes().rend(); ++ii) {
+      pending.push_back(make_pair(*ii, scope));
+    }
+  }
+
+  // A function expression's name is outside of its parameters and locals, so
+  // it only gets a binding if none of those have the same name. Otherwise it
+  // still gets one, but nothing can refer to it.
+  for (vector<pair<Node*, unsigned int> >::iterator ii = named_expressions.begin(); ii != named_expressions.end(); ++ii) {
+    NodeIdentifier* name = static_cast<NodeIdentifier*>(ii->first);
+    scope_t& scope = this->_scopes[ii->second];
+    atom_t atom = this->_atoms.intern(name->name());
+    unsigned int binding = this->_bindings.size();
+    this->_bindings.push_back(binding_t());
+    binding_t& added = this->_bindings.back();
+    added.name = atom;
+    added.type = BINDING_FUNCTION_NAME;
+    added.scope = ii->second;
+    added.declaration = name;
+    scope.bindings.push_back(binding);
+    if (scope.names.find(atom) == AtomMap::NONE) {
+      scope.names.set(atom, binding);
+    }
+  }
+}
+
+// Every scope comes after its parent, so going through them backwards sees
+// all of a scope's children before the scope itself.
+void ScopeTree::propagateFlags() {
+  for (size_t ii = this->_scopes.size(); ii-- > 0; ) {
+    scope_t& scope = this->_scopes[ii];
+    scope.contains_with = scope.contains_with || scope.has_with;
+    scope.contains_eval = scope.contains_eval || scope.has_eval;
+    if (scope.parent != NONE) {
+      scope_t& parent = this->_scopes[scope.parent];
+      parent.contains_with = parent.contains_with || scope.contains_with;
+      parent.contains_eval = parent.contains_eval || scope.contains_eval;
+    }
+  }
+}
+
+// Second pass: resolves every identifier that names a variable
+void ScopeTree::resolveScopes(Node* root) {
+  vector<pair<Node*, unsigned int> > pending(1, make_pair(root, 0u));
+  vector<pair<unsigned int, unsigned int> > uses;
+  while (!pending.empty()) {
+    Node* node = pending.back().first;
+    unsigned int scope = pending.back().second;
+    pending.pop_back();
+    if (node == NULL) {
+      continue;
+    }
+
+    switch (node->kind()) {
+      case NODE_IDENTIFIER:
+        uses.push_back(make_pair(this->reference(scope, static_cast<NodeIdentifier*>(node), false), scope));
+        continue;
+
+      case NODE_FUNCTION_DECLARATION:
+      case NODE_FUNCTION_EXPRESSION: {
+        unsigned int inner = this->scopeOf(node);
+        node_list_t::iterator ii = node->childNodes().begin();
+        Node* name = *ii;
+        Node* args = *++ii;
+        Node* body = *++ii;
+        if (name != NULL) {
+          if (node->kind() == NODE_FUNCTION_DECLARATION) {
+            uses.push_back(make_pair(this->reference(scope, static_cast<NodeIdentifier*>(name), false), scope));
+          } else {
+            // Its binding is the last one declared in the function so far
+            unsigned int binding = this->_scopes[inner].bindings.back();
+            this->_bindings[binding].references.push_back(static_cast<NodeIdentifier*>(name));
+            this->_resolved.push_back(make_pair(name, binding));
+          }
+        }
+        pending.push_back(make_pair(body, inner));
+        pending.push_back(make_pair(args, inner));
+        continue;
+      }
+
+      case NODE_TRY: {
+        unsigned int inner = this->scopeOf(node);
+        if (inner != NONE) {
+          node_list_t::iterator ii = node->childNodes().begin();
+          Node* block = *ii;
+          Node* var = *++ii;
+          Node* catch_block = *++ii;
+          Node* finally_block = *++ii;
+          pending.push_back(make_pair(finally_block, scope));
+          pending.push_back(make_pair(catch_block, inner));
+          pending.push_back(make_pair(var, inner));
+          pending.push_back(make_pair(block, scope));
+          continue;
+        }
+        break;
+      }
+
+      // Property names and labels aren't variables
+      case NODE_STATIC_MEMBER_EXPRESSION:
+        pending.push_back(make_pair(node->childNodes().front(), scope));
+        continue;
+
+      case NODE_OBJECT_LITERAL_PROPERTY:
+      case NODE_LABEL:
+        pending.push_back(make_pair(node->childNodes().back(), scope));
+        continue;
+
+      case NODE_STATEMENT_WITH_EXPRESSION: {
+        node_statement_with_expression_t type = static_cast<NodeStatementWithExpression*>(node)->statementType();
+        if (type == BREAK || type == CONTINUE) {
+          continue;
+        }
+        break;
+      }
+
+      case NODE_ASSIGNMENT:
+      case NODE_FOR_IN:
+      case NODE_FOR_EACH_IN: {
+        Node* target = node->childNodes().front();
+        if (target != NULL && target->kind() == NODE_IDENTIFIER) {
+          uses.push_back(make_pair(this->reference(scope, static_cast<NodeIdentifier*>(target), true), scope));
+          node_list_t::reverse_iterator first(++node->childNodes().begin());
+          for (node_list_t::reverse_iterator ii = node->childNodes().rbegin(); ii != first; ++ii) {
+            pending.push_back(make_pair(*ii, scope));
+          }
+          continue;
+        }
+        break;
+      }
+
+      default:
+        break;
+    }
+    for (node_list_t::reverse_iterator ii = node->childNodes().rbegin(); ii != node->childNodes().rend(); ++ii) {
+      pending.push_back(make_pair(*ii, scope));
+    }
+  }
+  this->collectFree(uses);
+}
+
+// Resolves an identifier from the innermost scope out. `arguments` is
+// declared in the closest function the first time it comes up, and any other
+// name that's nowhere to be found is an undeclared global.
+unsigned int ScopeTree::reference(unsigned int scope, NodeIdentifier* identifier, bool write) {
+  atom_t name = this->_atoms.intern(identifier->name());
+  unsigned int binding = AtomMap::NONE;
+  unsigned int function = NONE;
+  for (unsigned int ii = scope; ii != NONE && binding == AtomMap::NONE; ii = this->_scopes[ii].parent) {
+    binding = this->_scopes[ii].names.find(name);
+    if (function == NONE && this->_scopes[ii].type == SCOPE_FUNCTION) {
+      function = ii;
+    }
+  }
+  if (binding == AtomMap::NONE) {
+    if (function != NONE && identifier->name() == "arguments") {
+      binding = this->declare(function, BINDING_ARGUMENTS, identifier);
+    } else {
+      binding = this->declare(0, BINDING_UNDECLARED, identifier);
+    }
+    this->_bindings[binding].declaration = NULL;
+  }
+  this->_bindings[binding].references.push_back(identifier);
+  if (write) {
+    this->_bindings[binding].writes.push_back(identifier);
+  }
+  this->_resolved.push_back(make_pair(identifier, binding));
+  return binding;
+}
+
+// Marks each binding free in every scope from where it's used up to where
+// it's declared. With the uses sorted by binding, a scope that's already
+// marked for the current binding has had everything above it marked too.
+void ScopeTree::collectFree(vector<pair<unsigned int, unsigned int> >& uses) {
+  sort(uses.begin(), uses.end());
+  vector<unsigned int> marked(this->_scopes.size(), NONE);
+  for (vector<pair<unsigned int, unsigned int> >::iterator ii = uses.begin(); ii != uses.end(); ++ii) {
+    unsigned int binding = ii->first;
+    unsigned int declared = this->_bindings[binding].scope;
+    for (unsigned int scope = ii->second; scope != declared && marked[scope] != binding; scope = this->_scopes[scope].parent) {
+      marked[scope] = binding;
+      this->_scopes[scope].free.push_back(binding);
+    }
+  }
+}
+
+unsigned int ScopeTree::scopeOf(const Node* node) const {
+  vector<pair<const Node*, unsigned int> >::const_iterator ii =
+    lower_bound(this->_scopeNodes.begin(), this->_scopeNodes.end(), make_pair(node, 0u));
+  return ii != this->_scopeNodes.end() && ii->first == node ? ii->second : NONE;
+}
+
+unsigned int ScopeTree::lookup(unsigned int scope, const string& name) const {
+  atom_t atom = this->_atoms.find(name);
+  if (atom == AtomTable::NONE) {
+    return NONE;
+  }
+  for (; scope != NONE; scope = this->_scopes[scope].parent) {
+    unsigned int binding = this->_scopes[scope].names.find(atom);
+    if (binding != AtomMap::NONE) {
+      return this->_bindings[binding].type == BINDING_UNDECLARED ? NONE : binding;
+    }
+  }
+  return NONE;
+}
+
+unsigned int ScopeTree::resolve(const NodeIdentifier* identifier) const {
+  vector<pair<const Node*, unsigned int> >::const_iterator ii =
+    lower_bound(this->_resolved.begin(), this->_resolved.end(), make_pair((const Node*)identifier, 0u));
+  return ii != this->_resolved.end() && ii->first == identifier ? ii->second : NONE;
+}
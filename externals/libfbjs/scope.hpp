@@ -0,0 +1,161 @@
+#pragma once
+#include "node.hpp"
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fbjs {
+
+  // Names interned by an AtomTable. Two names are the same atom exactly when
+  // they're the same string, so lookups hash and compare integers.
+  typedef unsigned int atom_t;
+
+  //
+  // AtomTable: interns names into atoms numbered from 0 in the order they're
+  // first seen. Open addressing keeps the table a single flat array.
+  class AtomTable {
+    public:
+      AtomTable();
+      atom_t intern(const std::string& name);
+
+      // The atom for `name`, or NONE if it's never been interned
+      atom_t find(const std::string& name) const;
+      const std::string& name(atom_t atom) const { return _names[atom]; }
+      size_t size() const { return _names.size(); }
+
+      static const atom_t NONE = (atom_t)-1;
+
+    protected:
+      std::vector<std::string> _names;
+      std::vector<atom_t> _slots;
+      size_t slot(const std::string& name) const;
+  };
+
+  //
+  // AtomMap: a flat open addressing map from atoms to unsigned ints
+  class AtomMap {
+    public:
+      AtomMap();
+      unsigned int find(atom_t atom) const;
+      void set(atom_t atom, unsigned int value);
+      size_t size() const { return _size; }
+
+      static const unsigned int NONE = (unsigned int)-1;
+
+    protected:
+      std::vector<std::pair<atom_t, unsigned int> > _slots;
+      size_t _size;
+      size_t slot(atom_t atom) const;
+  };
+
+  enum scope_enum {
+    SCOPE_GLOBAL,
+    SCOPE_FUNCTION,
+    SCOPE_CATCH, // the block of a catch clause, declaring only its variable
+  };
+
+  enum binding_enum {
+    BINDING_VAR,
+    BINDING_FUNCTION,
+    BINDING_PARAM,
+    BINDING_CATCH,
+    BINDING_FUNCTION_NAME, // a function expression's own name, seen only inside it
+    BINDING_ARGUMENTS,     // `arguments`, only when a function refers to it
+    BINDING_UNDECLARED,    // a global that's used but never declared
+  };
+
+  struct binding_t {
+    atom_t name;
+    binding_enum type;
+    unsigned int scope;
+
+    // The identifier that first declares it, or NULL for arguments and
+    // undeclared globals
+    NodeIdentifier* declaration;
+
+    // Every identifier that refers to it, declarations included, in source
+    // order
+    std::vector<NodeIdentifier*> references;
+
+    // The references that are assigned to by `=` or a for-in loop
+    std::vector<NodeIdentifier*> writes;
+  };
+
+  struct scope_t {
+    scope_enum type;
+    Node* node; // the program, function or try statement
+    unsigned int parent;
+    std::vector<unsigned int> children;
+
+    // Bindings declared here in declaration order, and by name
+    std::vector<unsigned int> bindings;
+    AtomMap names;
+
+    // Whether a `with` statement or a direct call to eval is in this scope
+    // itself, not counting nested scopes
+    bool has_with;
+    bool has_eval;
+
+    // The same, counting nested scopes
+    bool contains_with;
+    bool contains_eval;
+
+    // Bindings declared outside this scope that are referred to in it or in
+    // a scope nested in it, in the order they're numbered. Those are the
+    // names a declaration here mustn't shadow.
+    std::vector<unsigned int> free;
+  };
+
+  //
+  // ScopeTree: every scope in a program and the bindings declared in each,
+  // with each identifier resolved to the binding it refers to. Scopes and
+  // bindings are numbered; scope 0 is the global scope and every other scope
+  // comes after its parent.
+  //
+  // Usually there's no need to build one directly. NodeProgram::scopes()
+  // keeps one per program and builds it again once the program is edited in
+  // a way that could change it; a tree built by hand goes stale with the
+  // first edit.
+  class ScopeTree {
+    public:
+      ScopeTree(Node* root);
+
+      const AtomTable& atoms() const { return _atoms; }
+      const std::string& name(atom_t atom) const { return _atoms.name(atom); }
+
+      size_t scopeCount() const { return _scopes.size(); }
+      const scope_t& scope(unsigned int scope) const { return _scopes[scope]; }
+      size_t bindingCount() const { return _bindings.size(); }
+      const binding_t& binding(unsigned int binding) const { return _bindings[binding]; }
+
+      // The scope a program, function or try statement starts, or NONE.
+      // Catch clauses start a scope only when they have a variable.
+      unsigned int scopeOf(const Node* node) const;
+
+      // The binding `name` refers to in `scope`, or NONE if it's undeclared
+      unsigned int lookup(unsigned int scope, const std::string& name) const;
+
+      // The binding an identifier refers to, or NONE for identifiers that
+      // aren't variables, like property names and labels
+      unsigned int resolve(const NodeIdentifier* identifier) const;
+
+      static const unsigned int NONE = (unsigned int)-1;
+
+    protected:
+      AtomTable _atoms;
+      std::vector<scope_t> _scopes;
+      std::vector<binding_t> _bindings;
+
+      // Sorted by node, for scopeOf() and resolve()
+      std::vector<std::pair<const Node*, unsigned int> > _scopeNodes;
+      std::vector<std::pair<const Node*, unsigned int> > _resolved;
+
+      unsigned int addScope(scope_enum type, Node* node, unsigned int parent);
+      unsigned int declare(unsigned int scope, binding_enum type, NodeIdentifier* identifier);
+      void declareScopes(Node* root);
+      void resolveScopes(Node* root);
+      void propagateFlags();
+      unsigned int reference(unsigned int scope, NodeIdentifier* identifier, bool write);
+      void collectFree(std::vector<std::pair<unsigned int, unsigned int> >& uses);
+  };
+}
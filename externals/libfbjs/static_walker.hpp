@@ -0,0 +1,169 @@
+#pragma once
+#include "node.hpp"
+
+namespace fbjs {
+
+  //
+  // StaticNodeWalker: compile-time counterpart to NodeWalker. A pass derives
+  // from StaticNodeWalker<Pass> and defines visit() only for the node types it
+  // cares about. Every other type falls back to its base type the same way it
+  // does with NodeWalker, except the fallbacks are resolved by the compiler and
+  // the only runtime dispatch is one switch on Node::kind().
+  //
+  //   class CountCalls : public StaticNodeWalker<CountCalls> {
+  //     public:
+  //       using StaticNodeWalker<CountCalls>::visit;
+  //       size_t calls;
+  //       CountCalls() : calls(0) {}
+  //       void visit(NodeFunctionCall& node) {
+  //         ++calls;
+  //         visitChildren();
+  //       }
+  //   };
+  //
+  // The using declaration is required, otherwise the pass's own visit()
+  // hides the fallbacks. Removing and replacing nodes works as in NodeWalker.
+  template<class Derived>
+  class StaticNodeWalker {
+    private:
+      struct frame_t {
+        Node* node;
+        frame_t* parent;
+        bool remove;
+        bool skip_delete;
+        bool children_done;
+      };
+      frame_t* _frame;
+
+      Derived& derived() {
+        return *static_cast<Derived*>(this);
+      }
+
+      void dispatch(Node* node) {
+        switch (node->kind()) {
+#define FBJS_STATIC_WALKER_CASE(TYPE, FALLBACK, KIND) \
+          case KIND: \
+            derived().visit(static_cast<TYPE&>(*node)); \
+            break;
+          FBJS_NODE_TYPES(FBJS_STATIC_WALKER_CASE)
+#undef FBJS_STATIC_WALKER_CASE
+          default:
+            derived().visit(*node);
+            break;
+        }
+      }
+
+    public:
+      StaticNodeWalker() : _frame(NULL) {}
+
+      Node* walk(Node* root) {
+        frame_t frame = { root, NULL, false, false, false };
+        frame_t* outer = _frame;
+        _frame = &frame;
+        replaceAndVisit(root);
+        _frame = outer;
+        return frame.node;
+      }
+
+      // Visits one node as if its children had just been walked: the first
+      // visitChildren() call it makes returns straight away. This lets a
+      // post-order walker run as a step of somebody else's traversal. Returns
+      // the node that should take its place, or NULL with `removed` set if
+      // the walker removed it. Unlike walk(), nothing is deleted here: the
+      // old node is still in its parent, and once the caller has spliced the
+      // result in, deleting the old node is up to them.
+      Node* visitAfterChildren(Node* node, Node* parent, bool& removed) {
+        frame_t parent_frame = { parent, NULL, false, false, false };
+        frame_t frame = { node, &parent_frame, false, false, true };
+        frame_t* outer = _frame;
+        _frame = &frame;
+        dispatch(node);
+        _frame = outer;
+
+        removed = frame.remove;
+        return frame.remove ? NULL : frame.node;
+      }
+
+      Node* node() const {
+        return _frame->node;
+      }
+
+      // Node being visited one level up, or NULL at the root
+      Node* parentNode() const {
+        return _frame->parent == NULL ? NULL : _frame->parent->node;
+      }
+
+    protected:
+      void remove(bool skip_delete = false) {
+        _frame->remove = true;
+        _frame->skip_delete = skip_delete;
+      }
+
+      void replace(Node* new_node, bool skip_delete = false) {
+        if (new_node && _frame->node) {
+          new_node->setLineno(_frame->node->lineno());
+        }
+        _frame->node = new_node;
+        _frame->remove = false;
+        _frame->skip_delete = skip_delete;
+        _frame->children_done = false;
+      }
+
+      void replaceAndVisit(Node* new_node) {
+        replace(new_node);
+        if (new_node == NULL) {
+          derived().visit();
+        } else {
+          dispatch(new_node);
+        }
+        if (new_node != _frame->node && new_node) {
+          delete new_node;
+        }
+      }
+
+      void visitChildren() {
+        if (_frame->children_done) {
+          _frame->children_done = false;
+          return;
+        }
+        node_list_t::iterator ii = _frame->node->childNodes().begin();
+        while (ii != _frame->node->childNodes().end()) {
+          visitChild(ii++);
+        }
+      }
+
+      void visitChild(node_list_t::iterator ii) {
+        frame_t frame = { *ii, _frame, false, false, false };
+        _frame = &frame;
+        if (*ii == NULL) {
+          derived().visit();
+        } else {
+          dispatch(*ii);
+        }
+        _frame = frame.parent;
+
+        Node* old_node = NULL;
+        if (frame.remove) {
+          old_node = _frame->node->removeChild(ii);
+        } else if (*ii != frame.node) {
+          old_node = _frame->node->replaceChild(frame.node, ii);
+        }
+
+        if (!frame.skip_delete && old_node) {
+          delete old_node;
+        }
+      }
+
+    public:
+      void visit() {}
+      void visit(Node& node) {
+        visitChildren();
+      }
+#define FBJS_STATIC_WALKER_FALLBACK(TYPE, FALLBACK, KIND) \
+      void visit(TYPE& node) { \
+        derived().visit(static_cast<FALLBACK&>(node)); \
+      }
+      FBJS_NODE_TYPES(FBJS_STATIC_WALKER_FALLBACK)
+#undef FBJS_STATIC_WALKER_FALLBACK
+  };
+}
@@ -1,7 +1,5 @@
 #pragma once
-#include <memory>
-#include <utility>
-#include <boost/ptr_container/ptr_vector.hpp>
+#include <stdexcept>
 #include "node.hpp"
 
 #define NODE_WALKER_VISIT_IMPL(TYPE, FALLBACK) \
@@ -16,33 +14,64 @@
 
 namespace fbjs {
   class NodeWalker {
-    private:
-      NodeWalker* _parent;
-      Node* _node;
-      bool _remove;
-      bool _skip_delete;
+    public:
 
-    protected:
-      typedef boost::ptr_vector<NodeWalker> ptr_vector;
+      // One level of the path from the root down to the node being visited.
+      // Frames live on the C++ stack while their node is being visited, so a
+      // walk doesn't allocate anything.
+      class Frame {
+        friend class NodeWalker;
+        private:
+          Node* _node;
+          Frame* _parent;
+          NodeWalker* _walker;
+          bool _remove;
+          bool _skip_delete;
+
+        public:
+          Frame(Node* node, Frame* parent, NodeWalker* walker) : _node(node),
+            _parent(parent), _walker(walker), _remove(false),
+            _skip_delete(false) {};
+          Node* node() const {
+            return _node;
+          }
+          Frame* parent() const {
+            return _parent;
+          }
+          NodeWalker* walker() const {
+            return _walker;
+          }
+      };
 
-    public:
-      typedef std::auto_ptr<NodeWalker> ptr;
+    private:
+      Frame* _frame;
 
-      NodeWalker() : _parent(NULL), _node(NULL), _remove(false),
-        _skip_delete(false) {};
+    public:
+      NodeWalker() : _frame(NULL) {};
       virtual ~NodeWalker() {};
-      virtual NodeWalker* clone() const = 0;
+
+      // By default one walker visits every node. Walkers which need their own
+      // state for each node can return a copy of themselves here; the copy
+      // visits one child and is then thrown away.
+      virtual NodeWalker* clone() const {
+        return NULL;
+      }
+
       virtual Node* walk(Node* root) {
+        Frame frame(root, NULL, this);
+        Frame* outer = _frame;
+        _frame = &frame;
         replaceAndVisit(root);
-        return _node;
+        _frame = outer;
+        return frame._node;
       }
 
-      NodeWalker* parent() const {
-        return _parent;
+      Frame* parent() const {
+        return _frame->_parent;
       }
 
       Node* node() const {
-        return _node;
+        return _frame->_node;
       }
 
     protected:
@@ -56,25 +85,18 @@ namespace fbjs {
         }
       }
 
-      template<class T>
-      static std::auto_ptr<T> cast(NodeWalker::ptr node) {
-        std::auto_ptr<T> casted(&cast<T>(*node));
-        node.release();
-        return casted;
-      }
-
       void remove(bool skip_delete = false) {
-        _remove = true;
-        _skip_delete = skip_delete;
+        _frame->_remove = true;
+        _frame->_skip_delete = skip_delete;
       }
 
       void replace(Node* new_node, bool skip_delete = false) {
-        if (new_node && _node) {
-          new_node->setLineno(_node->lineno());
+        if (new_node && _frame->_node) {
+          new_node->setLineno(_frame->_node->lineno());
         }
-        _node = new_node;
-        _remove = false;
-        _skip_delete = skip_delete;
+        _frame->_node = new_node;
+        _frame->_remove = false;
+        _frame->_skip_delete = skip_delete;
       }
 
       void replaceAndVisit(Node* new_node) {
@@ -84,42 +106,46 @@ namespace fbjs {
         } else {
           new_node->accept(*this);
         }
-        if (new_node != _node && new_node) {
+        if (new_node != _frame->_node && new_node) {
           delete new_node;
         }
       }
 
-      std::auto_ptr<ptr_vector> visitChildren() {
-        ptr_vector ret;
-        node_list_t::iterator ii = _node->childNodes().begin();
-        while (ii != _node->childNodes().end()) {
-          ret.push_back(visitChild(ii++).release());
+      void visitChildren() {
+        node_list_t::iterator ii = _frame->_node->childNodes().begin();
+        while (ii != _frame->_node->childNodes().end()) {
+          visitChild(ii++);
         }
-        return ret.release();
       }
 
-      ptr visitChild(node_list_t::iterator ii) {
-        ptr walker(clone());
-        walker->_parent = this;
-        walker->_node = *ii;
+      void visitChild(node_list_t::iterator ii) {
+        NodeWalker* walker = clone();
+        if (walker == NULL) {
+          walker = this;
+        }
+        Frame frame(*ii, _frame, walker);
+        Frame* outer = walker->_frame;
+        walker->_frame = &frame;
         if (*ii == NULL) {
-          visit();
+          walker->visit();
         } else {
           (*ii)->accept(*walker);
         }
+        walker->_frame = outer;
+        if (walker != this) {
+          delete walker;
+        }
 
         Node* old_node = NULL;
-        if (walker->_remove) {
-          old_node = _node->removeChild(ii);
-        } else if (*ii != walker->_node) {
-          old_node = _node->replaceChild(walker->_node, ii);
+        if (frame._remove) {
+          old_node = _frame->_node->removeChild(ii);
+        } else if (*ii != frame._node) {
+          old_node = _frame->_node->replaceChild(frame._node, ii);
         }
 
-        if (!walker->_skip_delete && old_node) {
+        if (!frame._skip_delete && old_node) {
           delete old_node;
         }
-
-        return walker;
       }
 
     public:
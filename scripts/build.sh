@@ -7,3 +7,6 @@ ROOT=`dirname $0`"/../"
 (cd ${ROOT}support/javelinsymbols && make)
 (cd ${ROOT}support/jsast && make)
 (cd ${ROOT}support/jsxmin && make)
+(cd ${ROOT}support/jsquery && make)
+(cd ${ROOT}support/jslint && make)
+(cd ${ROOT}support/jsbench && make)
@@ -0,0 +1,37 @@
+#!/bin/sh
+
+# Runs a program with one very deep expression, a0+a1+a2+... with 100,000
+# terms by default, through each libfbjs tool that walks whole trees. Any of
+# them that crashes or exits with an error fails the check. Build the tools
+# first with scripts/build.sh, or point JSXMIN, JSAST, JAVELINSYMBOLS or
+# JSBENCH at binaries built elsewhere.
+#
+#   javelin/ $ ./scripts/deep-nesting.sh [terms]
+
+ROOT=`dirname $0`"/../"
+TERMS=${1:-100000}
+JSXMIN=${JSXMIN:-${ROOT}support/jsxmin/jsxmin}
+JSAST=${JSAST:-${ROOT}support/jsast/jsast}
+JAVELINSYMBOLS=${JAVELINSYMBOLS:-${ROOT}support/javelinsymbols/javelinsymbols}
+JSBENCH=${JSBENCH:-${ROOT}support/jsbench/jsbench}
+
+INPUT=`mktemp /tmp/deep-nesting.XXXXXX`
+trap 'rm -f $INPUT' EXIT
+awk -v terms=$TERMS 'BEGIN {
+  printf "x = a0";
+  for (ii = 1; ii < terms; ++ii) {
+    printf " + a%d", ii;
+  }
+  print ";";
+}' > $INPUT
+
+STATUS=0
+for TOOL in "$JSXMIN" "$JSAST" "$JAVELINSYMBOLS" "$JSBENCH --runs=1 $INPUT"; do
+  if $TOOL < $INPUT > /dev/null; then
+    echo "ok: $TOOL"
+  else
+    echo "FAILED with status $?: $TOOL"
+    STATUS=1
+  fi
+done
+exit $STATUS
@@ -0,0 +1,42 @@
+#!/bin/sh
+
+# Times finding the functions that contain with or eval on N functions nested
+# inside each other, with and without an eval in the innermost one. For each
+# N it prints how long jsbench takes to build the scope tree and read its
+# flags, and how long jsxmin takes end to end. Point JSXMIN or JSBENCH at
+# binaries built from another revision to compare the two.
+#
+#   javelin/ $ ./scripts/nesting-benchmark.sh [N ...]
+#
+# The parser runs out of stack at around 1200 levels of nesting, so N has to
+# stay below that.
+
+ROOT=`dirname $0`"/../"
+JSXMIN=${JSXMIN:-${ROOT}support/jsxmin/jsxmin}
+JSBENCH=${JSBENCH:-${ROOT}support/jsbench/jsbench}
+SIZES=${*:-100 200 400 800}
+
+INPUT=`mktemp /tmp/nesting-benchmark.XXXXXX`
+trap 'rm -f $INPUT' EXIT
+
+printf "%6s  %-5s  %10s  %10s\n" N eval "scopes ms" "jsxmin ms"
+for N in $SIZES; do
+  for EVAL in no yes; do
+    awk -v depth=$N -v eval=$EVAL 'BEGIN {
+      for (ii = 0; ii < depth; ++ii) {
+        printf "function f%d(arg%d){var local%d=arg%d+1;", ii, ii, ii, ii;
+      }
+      printf eval == "yes" ? "eval(\x27local0\x27);" : "local0++;";
+      for (ii = 0; ii < depth; ++ii) {
+        printf "}";
+      }
+      print "";
+    }' > $INPUT
+    TIMINGS=`$JSBENCH --runs=5 $INPUT` || exit 1
+    SCOPES=`echo "$TIMINGS" | sed 's/.* scopes \([0-9.]*\) .*/\1/'`
+    START=`date +%s%N`
+    $JSXMIN < $INPUT > /dev/null || exit 1
+    END=`date +%s%N`
+    printf "%6s  %-5s  %10s  %10s\n" $N $EVAL $SCOPES `expr \( $END - $START \) / 1000000`
+  done
+done
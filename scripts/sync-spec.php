@@ -67,6 +67,7 @@ class JavelinSyncSpec {
     $packages = JavelinSyncSpec::getPackageMap();
     $data = array();
 
+    $dev = array();
     foreach ($packages as $package => $items) {
       $content = array();
       foreach ($items as $item) {
@@ -78,12 +79,25 @@ class JavelinSyncSpec {
       $content = implode("\n\n", $content);
 
       echo "Writing {$package}.dev.js...\n";
-      Filesystem::writeFile($root.'/pkg/'.$package.'.dev.js', $content);
+      $dev[$package] = $root.'/pkg/'.$package.'.dev.js';
+      Filesystem::writeFile($dev[$package], $content);
+    }
 
+    // Private members of classes are renamed the same way in every package,
+    // so each one is minified knowing about all of the others. The names
+    // each build gives out are kept for the next one, so code that hasn't
+    // changed minifies the same way it did before.
+    foreach ($dev as $package => $path) {
       echo "Writing {$package}.min.js...\n";
-      $exec = new ExecFuture($root.'/support/jsxmin/jsxmin __DEV__:0');
-      $exec->write($content);
-      list($stdout) = $exec->resolvex();
+      $exec = new ExecFuture(
+        '%s --gzip --stats --members=%s --names=%s --member-names=%s __DEV__:0',
+        $root.'/support/jsxmin/jsxmin',
+        implode(',', $dev),
+        $root.'/pkg/'.$package.'.names',
+        $root.'/pkg/members.names');
+      $exec->write(Filesystem::readFile($path));
+      list($stdout, $stderr) = $exec->resolvex();
+      echo "  ".$stderr;
 
       Filesystem::writeFile($root.'/pkg/'.$package.'.min.js', $stdout);
     }
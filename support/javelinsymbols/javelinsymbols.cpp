@@ -4,6 +4,7 @@
 #include <iostream>
 #include <string.h>
 #include <map>
+#include <vector>
 
 using namespace fbjs;
 using namespace std;
@@ -17,20 +18,25 @@ typedef map<string, int> symbol_t;
 
 string get_static_member_symbol(Node *node);
 
-void find_symbols(Node *node, symbol_t &installs, symbol_t &behaviors,
+// Only member expressions and calls can name a symbol, so rather than walk
+// the whole tree this looks them up in the index the parser built. Each list
+// is in source order, the same order a walk would have found them in.
+void find_symbols(NodeProgram *root, symbol_t &installs, symbol_t &behaviors,
                   symbol_t &uses) {
-  if (node == NULL) {
-    return;
-  }
-
-  if (typeid(*node) == typeid(NodeStaticMemberExpression)) {
-    string symbol = get_static_member_symbol(node);
+  const vector<Node *> &members =
+    root->index()->nodes(NODE_STATIC_MEMBER_EXPRESSION);
+  for (vector<Node *>::const_iterator ii = members.begin();
+       ii != members.end(); ++ii) {
+    string symbol = get_static_member_symbol(*ii);
     if (symbol[0] == 'J' && symbol[1] == 'X' && symbol[2] == '.') {
-      uses[symbol] = node->lineno();
+      uses[symbol] = (*ii)->lineno();
     }
   }
 
-  if (typeid(*node) == typeid(NodeFunctionCall)) {
+  const vector<Node *> &calls = root->index()->nodes(NODE_FUNCTION_CALL);
+  for (vector<Node *>::const_iterator ii = calls.begin();
+       ii != calls.end(); ++ii) {
+    Node *node = *ii;
     Node *call = *node->childNodes().begin();
     if (static_cast<NodeStaticMemberExpression *>(call)) {
       string symbol = get_static_member_symbol(call);
@@ -47,10 +53,6 @@ void find_symbols(Node *node, symbol_t &installs, symbol_t &behaviors,
       }
     }
   }
-
-  for_nodes(node, ii) {
-    find_symbols(*ii, installs, behaviors, uses);
-  }
 }
 
 string get_static_member_symbol(Node *node) {
@@ -79,7 +81,7 @@ string get_static_member_symbol(Node *node) {
 
 int main(int argc, char* argv[]) {
   try {
-    NodeProgram root(stdin); // parses
+    NodeProgram root(stdin, PARSE_INDEX); // parses
 
     symbol_t installs;
     symbol_t behaviors;
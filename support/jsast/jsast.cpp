@@ -3,6 +3,7 @@
 #include <iostream>
 #include <string.h>
 #include <map>
+#include <vector>
 
 using namespace fbjs;
 using namespace std;
@@ -112,25 +113,28 @@ string get_node_value(Node *node) {
   return "";
 }
 
-void print_tree(Node *node) {
+// A node that's been opened but not closed yet, and the next child of it to
+// print.
+struct print_frame_t {
+  Node *node;
+  node_list_t::iterator next;
+  bool skip_body;
+  bool is_first;
+};
+
+void print_open(Node *node, vector<print_frame_t> &stack) {
   printf("[\"%s\", [", get_node_name(node));
 
-  bool skip_body = (typeid(*node) == typeid(NodeFunctionExpression));
-  bool is_first = true;
-  for_nodes(node, ii) {
-    if (*ii) {
-      if (skip_body && typeid(**ii) == typeid(NodeStatementList)) {
-        break;
-      }
-      if (is_first) {
-        is_first = false;
-      } else {
-        printf(", ");
-      }
-      print_tree(*ii);
-    }
-  }
+  print_frame_t frame = {
+    node,
+    node->childNodes().begin(),
+    typeid(*node) == typeid(NodeFunctionExpression),
+    true
+  };
+  stack.push_back(frame);
+}
 
+void print_close(Node *node) {
   printf("]");
   string s = get_node_value(node);
   if (s.length()) {
@@ -153,6 +157,34 @@ void print_tree(Node *node) {
   printf("]");
 }
 
+// Prints the tree off an explicit stack, since generated code can nest deep
+// enough to overflow the C stack.
+void print_tree(Node *root) {
+  vector<print_frame_t> stack;
+  print_open(root, stack);
+  while (!stack.empty()) {
+    print_frame_t &top = stack.back();
+    if (top.next == top.node->childNodes().end() ||
+        (*top.next && top.skip_body &&
+         typeid(**top.next) == typeid(NodeStatementList))) {
+      Node *node = top.node;
+      stack.pop_back();
+      print_close(node);
+      continue;
+    }
+
+    Node *child = *top.next++;
+    if (child) {
+      if (top.is_first) {
+        top.is_first = false;
+      } else {
+        printf(", ");
+      }
+      print_open(child, stack);
+    }
+  }
+}
+
 
 int main(int argc, char* argv[]) {
   try {
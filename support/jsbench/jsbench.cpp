@@ -0,0 +1,226 @@
+#include "libfbjs/node.hpp"
+#include "libfbjs/scope.hpp"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <vector>
+
+using namespace fbjs;
+using namespace std;
+
+// Milliseconds each step took. Each is the best of all the runs, since
+// anything slower than that is noise from the rest of the machine. Also how
+// many scopes contain with or eval.
+struct timings_t {
+  double parse;
+  double clone;
+  double compare;
+  double render;
+  double scopes;
+  double destroy;
+  unsigned int tainted;
+};
+
+static double now() {
+  timeval time;
+  gettimeofday(&time, NULL);
+  return time.tv_sec * 1e3 + time.tv_usec / 1e3;
+}
+
+static void keep_best(double& best, double time) {
+  if (best < 0 || time < best) {
+    best = time;
+  }
+}
+
+static bool time_file(const char* file, timings_t& best) {
+  FILE* input = fopen(file, "r");
+  if (input == NULL) {
+    fprintf(stderr, "%s: %s\n", file, strerror(errno));
+    return false;
+  }
+  NodeProgram* root;
+  double start = now();
+  try {
+    root = new NodeProgram(input);
+  } catch (const ParseException& ex) {
+    fprintf(stderr, "%s: %s\n", file, ex.what());
+    fclose(input);
+    return false;
+  }
+  double parsed = now();
+  fclose(input);
+
+  Node* copy = root->clone();
+  double cloned = now();
+  bool same = *copy == *root;
+  double compared = now();
+  rope_t output = root->render(RENDER_NONE);
+  output.c_str();
+  double rendered = now();
+
+  // What the renamer asks of every function before it renames it
+  ScopeTree* tree = new ScopeTree(root);
+  best.tainted = 0;
+  for (size_t ii = 0; ii < tree->scopeCount(); ++ii) {
+    const scope_t& scope = tree->scope(ii);
+    best.tainted += scope.contains_with || scope.contains_eval;
+  }
+  double scoped = now();
+  delete tree;
+  delete copy;
+  delete root;
+  double deleted = now();
+  if (!same) {
+    fprintf(stderr, "%s: the clone isn't equal to the original\n", file);
+    return false;
+  }
+
+  keep_best(best.parse, parsed - start);
+  keep_best(best.clone, cloned - parsed);
+  keep_best(best.compare, compared - cloned);
+  keep_best(best.render, rendered - compared);
+  keep_best(best.scopes, scoped - rendered);
+  keep_best(best.destroy, deleted - scoped);
+  return true;
+}
+
+static string as_string(const rope_t& rope) {
+  return string(rope.c_str(), rope.size());
+}
+
+// Marks every other statement and object literal property as changed,
+// starting with the first one if `touch' is set, so RENDER_VERBATIM has to
+// stitch code copied from the source to freshly rendered code all over.
+static void touch_alternate(Node* root, bool touch) {
+  vector<Node*> pending(1, root);
+  while (!pending.empty()) {
+    Node* node = pending.back();
+    pending.pop_back();
+    bool list = node->kind() == NODE_STATEMENT_LIST || node->kind() == NODE_OBJECT_LITERAL;
+    for (node_list_t::iterator ii = node->childNodes().begin(); ii != node->childNodes().end(); ++ii) {
+      if (*ii == NULL) {
+        continue;
+      }
+      if (list) {
+        if (touch) {
+          (*ii)->setLineno((*ii)->lineno());
+        }
+        touch = !touch;
+      }
+      pending.push_back(*ii);
+    }
+  }
+}
+
+static NodeProgram* parse_file(const char* file, FILE* input, node_parse_enum opts) {
+  try {
+    return new NodeProgram(input, opts);
+  } catch (const ParseException& ex) {
+    fprintf(stderr, "%s: %s\n", file, ex.what());
+    return NULL;
+  }
+}
+
+// Whether RENDER_VERBATIM gives back the file as it was when nothing has
+// changed, and code that parses the same as the usual rendering once half
+// of it has.
+static bool check_verbatim(const char* file) {
+  FILE* input = fopen(file, "r");
+  if (input == NULL) {
+    fprintf(stderr, "%s: %s\n", file, strerror(errno));
+    return false;
+  }
+  string original;
+  char buf[8192];
+  size_t read;
+  while ((read = fread(buf, 1, sizeof(buf), input)) > 0) {
+    original.append(buf, read);
+  }
+  const int modes[] = {RENDER_VERBATIM, RENDER_PRETTY | RENDER_VERBATIM};
+  const size_t mode_count = sizeof(modes) / sizeof(modes[0]);
+
+  rewind(input);
+  NodeProgram* root = parse_file(file, input, PARSE_SOURCE);
+  bool ok = root != NULL;
+  for (size_t ii = 0; ii < mode_count && ok; ++ii) {
+    if (as_string(root->render(modes[ii])) != original) {
+      fprintf(stderr, "%s: the untouched verbatim rendering isn't the file\n", file);
+      ok = false;
+    }
+  }
+  delete root;
+
+  // Once starting with the first statement, once with the second
+  for (int first = 0; first < 2 && ok; ++first) {
+    rewind(input);
+    root = parse_file(file, input, PARSE_SOURCE);
+    if (root == NULL) {
+      ok = false;
+      break;
+    }
+    touch_alternate(root, first);
+    string expected = as_string(root->render(RENDER_NONE));
+    for (size_t ii = 0; ii < mode_count && ok; ++ii) {
+      rope_t output = root->render(modes[ii]);
+      FILE* verbatim = tmpfile();
+      fwrite(output.c_str(), 1, output.size(), verbatim);
+      rewind(verbatim);
+      NodeProgram* again = parse_file(file, verbatim, PARSE_NONE);
+      fclose(verbatim);
+      if (again == NULL || as_string(again->render(RENDER_NONE)) != expected) {
+        fprintf(stderr, "%s: the verbatim rendering of a changed tree doesn't parse the same\n", file);
+        ok = false;
+      }
+      delete again;
+    }
+    delete root;
+  }
+  fclose(input);
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+
+  // Usage: jsbench [--runs=N] file ...
+  //   --runs=N  time each file this many times and keep the best, default 5
+  // Times parsing each file and then cloning, comparing, rendering and
+  // deleting its tree, which is what every tool built on libfbjs spends
+  // its time on, and building its scopes along with which of them contain
+  // with or eval. Build with OPT=1 to get numbers worth comparing. Exits
+  // with 1 if a file couldn't be read or parsed, its clone came out
+  // different, or RENDER_VERBATIM got it wrong, see check_verbatim().
+  vector<const char*> files;
+  int runs = 5;
+  for (int ii = 1; ii < argc; ++ii) {
+    if (strncmp(argv[ii], "--runs=", 7) == 0) {
+      runs = atoi(argv[ii] + 7);
+    } else {
+      files.push_back(argv[ii]);
+    }
+  }
+  if (files.empty() || runs < 1) {
+    fprintf(stderr, "usage: jsbench [--runs=N] file ...\n");
+    return 1;
+  }
+
+  bool failed = false;
+  for (vector<const char*>::iterator ii = files.begin(); ii != files.end(); ++ii) {
+    timings_t best = {-1, -1, -1, -1, -1, -1, 0};
+    bool ok = check_verbatim(*ii);
+    for (int run = 0; run < runs && ok; ++run) {
+      ok = time_file(*ii, best);
+    }
+    if (!ok) {
+      failed = true;
+      continue;
+    }
+    printf("%s: parse %.2f clone %.2f compare %.2f render %.2f scopes %.2f delete %.2f ms, "
+      "%u scopes with eval or with\n",
+      *ii, best.parse, best.clone, best.compare, best.render, best.scopes, best.destroy, best.tainted);
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,138 @@
+#include "libfbjs/node.hpp"
+#include "libfbjs/lint.hpp"
+
+#include <errno.h>
+#include <iostream>
+#include <pthread.h>
+#include <set>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace fbjs;
+using namespace std;
+
+struct file_result_t {
+  string output;
+  unsigned int lints;
+  bool failed;
+};
+
+struct lint_job_t {
+  const set<string>* ignored;
+  const vector<const char*>* files;
+  vector<file_result_t>* results;
+  size_t next;
+};
+
+static void lint_file(const lint_job_t* job, const char* file, file_result_t& result) {
+  result.lints = 0;
+  result.failed = false;
+  FILE* input = strcmp(file, "-") == 0 ? stdin : fopen(file, "r");
+  if (input == NULL) {
+    result.output = string(file) + ": " + strerror(errno) + "\n";
+    result.failed = true;
+    return;
+  }
+
+  try {
+    NodeProgram root(input, PARSE_INDEX);
+    vector<lint_t> lints = lint(*root.scopes());
+    char lineno[16];
+    for (vector<lint_t>::iterator ii = lints.begin(); ii != lints.end(); ++ii) {
+      if (job->ignored->count(lintName(ii->type))) {
+        continue;
+      }
+      snprintf(lineno, sizeof(lineno), ":%u: ", ii->lineno);
+      result.output += file;
+      result.output += lineno;
+      result.output += ii->message;
+      result.output += " [";
+      result.output += lintName(ii->type);
+      result.output += "]\n";
+      ++result.lints;
+    }
+  } catch (const ParseException& ex) {
+    result.output = string(file) + ": " + ex.what() + "\n";
+    result.failed = true;
+  }
+  if (input != stdin) {
+    fclose(input);
+  }
+}
+
+static void* lint_worker(void* arg) {
+  lint_job_t* job = static_cast<lint_job_t*>(arg);
+  while (true) {
+    size_t ii = __sync_fetch_and_add(&job->next, 1);
+    if (ii >= job->files->size()) {
+      break;
+    }
+    lint_file(job, (*job->files)[ii], (*job->results)[ii]);
+  }
+  return NULL;
+}
+
+int main(int argc, char* argv[]) {
+
+  // Usage: jslint [--ignore=kind,...] [--threads=N] [file ...]
+  //   --ignore=a,b  don't report these kinds of lint: implicit-global,
+  //                 unused-var, unused-param or shadow
+  //   --threads=N   parse this many files at once, default one per CPU
+  // Reads stdin when no files are given. These are the same diagnostics
+  // jsxmin --lint prints, see libfbjs/lint.hpp. Exits with 0 if there were
+  // none, 1 if there were and 2 if a file couldn't be read or parsed.
+  vector<const char*> files;
+  set<string> ignored;
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  for (int ii = 1; ii < argc; ++ii) {
+    if (strncmp(argv[ii], "--ignore=", 9) == 0) {
+      for (char* kind = strtok(argv[ii] + 9, ","); kind != NULL; kind = strtok(NULL, ",")) {
+        ignored.insert(kind);
+      }
+    } else if (strncmp(argv[ii], "--threads=", 10) == 0) {
+      threads = atoi(argv[ii] + 10);
+    } else {
+      files.push_back(argv[ii]);
+    }
+  }
+  if (files.empty()) {
+    files.push_back("-");
+  }
+
+  vector<file_result_t> results(files.size());
+  lint_job_t job;
+  job.ignored = &ignored;
+  job.files = &files;
+  job.results = &results;
+  job.next = 0;
+
+  vector<pthread_t> workers;
+  for (long ii = 1; ii < threads && (size_t)ii < files.size(); ++ii) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, lint_worker, &job) == 0) {
+      workers.push_back(thread);
+    }
+  }
+  lint_worker(&job);
+  for (vector<pthread_t>::iterator ii = workers.begin(); ii != workers.end(); ++ii) {
+    pthread_join(*ii, NULL);
+  }
+
+  // Results come out in the order the files were given, however the work
+  // was split up.
+  bool linted = false;
+  bool failed = false;
+  for (size_t ii = 0; ii < files.size(); ++ii) {
+    file_result_t& result = results[ii];
+    if (result.failed) {
+      fputs(result.output.c_str(), stderr);
+      failed = true;
+      continue;
+    }
+    linted = linted || result.lints;
+    fputs(result.output.c_str(), stdout);
+  }
+  return failed ? 2 : linted ? 1 : 0;
+}
@@ -0,0 +1,179 @@
+#include "libfbjs/node.hpp"
+#include "libfbjs/query.hpp"
+
+#include <errno.h>
+#include <iostream>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace fbjs;
+using namespace std;
+
+// Longest snippet of a match that gets printed
+#define SNIPPET_LENGTH 100
+
+struct file_result_t {
+  string output;
+  unsigned int matches;
+  bool failed;
+};
+
+struct query_job_t {
+  const Selector* selector;
+  const vector<const char*>* files;
+  vector<file_result_t>* results;
+  bool list_files;
+  bool count;
+  size_t next;
+};
+
+// First line of a match, cut down to a readable length
+static string snippet(const Node* node) {
+  string text = node->render(RENDER_NONE).c_str();
+  size_t end = text.find('\n');
+  if (end > SNIPPET_LENGTH) {
+    end = SNIPPET_LENGTH;
+  }
+  if (end < text.size()) {
+    text.erase(end);
+    text += "...";
+  }
+  return text;
+}
+
+static void query_file(const query_job_t* job, const char* file, file_result_t& result) {
+  result.matches = 0;
+  result.failed = false;
+  FILE* input = strcmp(file, "-") == 0 ? stdin : fopen(file, "r");
+  if (input == NULL) {
+    result.output = string(file) + ": " + strerror(errno) + "\n";
+    result.failed = true;
+    return;
+  }
+
+  try {
+    NodeProgram root(input, PARSE_INDEX);
+    vector<Node*> matches;
+    job->selector->select(&root, matches);
+    result.matches = matches.size();
+    if (!job->list_files && !job->count) {
+      char lineno[16];
+      for (vector<Node*>::iterator ii = matches.begin(); ii != matches.end(); ++ii) {
+        snprintf(lineno, sizeof(lineno), ":%u: ", (*ii)->lineno());
+        result.output += file;
+        result.output += lineno;
+        result.output += snippet(*ii);
+        result.output += "\n";
+      }
+    }
+  } catch (const ParseException& ex) {
+    result.output = string(file) + ": " + ex.what() + "\n";
+    result.failed = true;
+  }
+  if (input != stdin) {
+    fclose(input);
+  }
+}
+
+static void* query_worker(void* arg) {
+  query_job_t* job = static_cast<query_job_t*>(arg);
+  while (true) {
+    size_t ii = __sync_fetch_and_add(&job->next, 1);
+    if (ii >= job->files->size()) {
+      break;
+    }
+    query_file(job, (*job->files)[ii], (*job->results)[ii]);
+  }
+  return NULL;
+}
+
+int main(int argc, char* argv[]) {
+
+  // Usage: jsquery [--count] [--files] [--threads=N] selector [file ...]
+  //   --count      print the number of matches in each file
+  //   --files      print only the names of files with matches
+  //   --threads=N  parse this many files at once, default one per CPU
+  // Reads stdin when no files are given. See libfbjs/query.hpp for the
+  // selector syntax. Exits with 0 if anything matched, 1 if nothing did and
+  // 2 if a file couldn't be read or parsed.
+  const char* pattern = NULL;
+  vector<const char*> files;
+  bool count = false;
+  bool list_files = false;
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  for (int ii = 1; ii < argc; ++ii) {
+    if (strcmp(argv[ii], "--count") == 0) {
+      count = true;
+    } else if (strcmp(argv[ii], "--files") == 0) {
+      list_files = true;
+    } else if (strncmp(argv[ii], "--threads=", 10) == 0) {
+      threads = atoi(argv[ii] + 10);
+    } else if (pattern == NULL) {
+      pattern = argv[ii];
+    } else {
+      files.push_back(argv[ii]);
+    }
+  }
+  if (pattern == NULL) {
+    fprintf(stderr, "usage: jsquery [--count] [--files] [--threads=N] selector [file ...]\n");
+    return 2;
+  }
+  if (files.empty()) {
+    files.push_back("-");
+  }
+
+  try {
+    Selector selector(pattern);
+    vector<file_result_t> results(files.size());
+    query_job_t job;
+    job.selector = &selector;
+    job.files = &files;
+    job.results = &results;
+    job.list_files = list_files;
+    job.count = count;
+    job.next = 0;
+
+    vector<pthread_t> workers;
+    for (long ii = 1; ii < threads && (size_t)ii < files.size(); ++ii) {
+      pthread_t thread;
+      if (pthread_create(&thread, NULL, query_worker, &job) == 0) {
+        workers.push_back(thread);
+      }
+    }
+    query_worker(&job);
+    for (vector<pthread_t>::iterator ii = workers.begin(); ii != workers.end(); ++ii) {
+      pthread_join(*ii, NULL);
+    }
+
+    // Results come out in the order the files were given, however the work
+    // was split up.
+    bool matched = false;
+    bool failed = false;
+    for (size_t ii = 0; ii < files.size(); ++ii) {
+      file_result_t& result = results[ii];
+      if (result.failed) {
+        fputs(result.output.c_str(), stderr);
+        failed = true;
+        continue;
+      }
+      matched = matched || result.matches;
+      if (count) {
+        printf("%s:%u\n", files[ii], result.matches);
+      } else if (list_files) {
+        if (result.matches) {
+          printf("%s\n", files[ii]);
+        }
+      } else {
+        fputs(result.output.c_str(), stdout);
+      }
+    }
+    return failed ? 2 : matched ? 0 : 1;
+
+  } catch (const SelectorException& ex) {
+    fprintf(stderr, "jsquery: %s\n", ex.what());
+    return 2;
+  }
+}
@@ -0,0 +1,246 @@
+#include "libfbjs/node.hpp"
+#include "libfbjs/scope.hpp"
+
+#include "jsxmin_closure.h"
+
+// Wrapping a package in a closure.
+//
+// Top-level declarations are properties of the global object, shared with
+// every other script on the page, so the renamer never touches them. Inside
+// a function they're ordinary locals. Javelin packages are mostly one big
+// JX.install() call after another and hardly declare anything at the top
+// level, but other packages built with jsxmin can.
+//
+// What a package exports is what it puts on `window`, and that keeps working
+// from inside a function. A top-level var or function that's also read or
+// written as `window.name` is shared with whatever else uses that property,
+// so it's exported as well. Exported declarations can't stay declarations in
+// the wrapper without becoming locals, so they're declared before it and
+// assigned inside:
+//   1. `var a = 1, b = 2, c;` with b exported becomes `var a = 1; b = 2; var c;`
+//   2. `function b() {...}` becomes `b = function() {...};` at the start of
+//      the wrapper, where the declaration would have been hoisted to, after
+//      any directive prologue.
+//
+// Calling the wrapper plainly leaves `this` as the global object, unless the
+// package is strict. So when `this` is used outside of any function, the
+// wrapper is called with it instead: `(function(){...}).call(this)`.
+
+using namespace std;
+using namespace fbjs;
+
+PackageClosure::PackageClosure(const string& exports) :
+    _locals(0), _skipped(NULL) {
+  size_t begin = 0;
+  while (begin < exports.size()) {
+    size_t end = exports.find(',', begin);
+    if (end == string::npos) {
+      end = exports.size();
+    }
+    if (end > begin) {
+      _exports.insert(exports.substr(begin, end - begin));
+    }
+    begin = end + 1;
+  }
+}
+
+// Names used as properties of the global `window`
+static void window_properties(NodeProgram* root, const ScopeTree* tree, set<string>& names) {
+  const vector<Node*>& members = root->index()->nodes(NODE_STATIC_MEMBER_EXPRESSION);
+  for (vector<Node*>::const_iterator ii = members.begin(); ii != members.end(); ++ii) {
+    Node* object = (*ii)->childNodes().front();
+    if (object == NULL || object->kind() != NODE_IDENTIFIER) {
+      continue;
+    }
+    unsigned int binding = tree->resolve(static_cast<NodeIdentifier*>(object));
+    if (binding != ScopeTree::NONE &&
+        tree->binding(binding).type == BINDING_UNDECLARED &&
+        tree->name(tree->binding(binding).name) == "window") {
+      names.insert(static_cast<NodeIdentifier*>((*ii)->childNodes().back())->name());
+    }
+  }
+}
+
+// The var statement or function declaration an identifier declares, or NULL
+// if it's just a reference
+static Node* declaration_of(Node* identifier) {
+  Node* parent = identifier->parent();
+  if (parent == NULL) {
+    return NULL;
+  }
+  if (parent->kind() == NODE_VAR_DECLARATION) {
+    return parent;
+  }
+  if (parent->kind() == NODE_FUNCTION_DECLARATION &&
+      parent->childNodes().front() == identifier) {
+    return parent;
+  }
+  if (parent->kind() == NODE_ASSIGNMENT &&
+      parent->childNodes().front() == identifier &&
+      parent->parent() != NULL &&
+      parent->parent()->kind() == NODE_VAR_DECLARATION) {
+    return parent->parent();
+  }
+  return NULL;
+}
+
+static const string& declared_name(Node* declarator) {
+  if (declarator->kind() == NODE_IDENTIFIER) {
+    return static_cast<NodeIdentifier*>(declarator)->name();
+  }
+  return static_cast<NodeIdentifier*>(declarator->childNodes().front())->name();
+}
+
+// Splits a var statement around its exported declarators, which turn into
+// assignments or go away if they have no value.
+static void split_var(Node* var, Node* body, const set<string>& exported) {
+  Node* locals = NULL;
+  while (!var->childNodes().empty()) {
+    Node* declarator = var->childNodes().front();
+    if (exported.count(declared_name(declarator))) {
+      locals = NULL;
+      if (declarator->kind() == NODE_ASSIGNMENT) {
+        body->insertBefore(declarator, var->position());
+      }
+    } else {
+      if (locals == NULL) {
+        locals = new NodeVarDeclaration(false, var->lineno());
+        body->insertBefore(locals, var->position());
+      }
+      locals->appendChild(declarator);
+    }
+    if (var->removeChild(var->childNodes().begin())->parent() == NULL) {
+      delete declarator;
+    }
+  }
+  delete body->removeChild(var->position());
+}
+
+// Turns an exported function declaration into an assignment of the same
+// function, taking the declaration out of the package
+static Node* export_function(Node* function, Node* body) {
+  node_list_t::iterator ii = function->childNodes().begin();
+  NodeIdentifier* name = static_cast<NodeIdentifier*>(*ii);
+  Node* expression = (new NodeFunctionExpression(function->lineno()))->appendChild(NULL);
+  expression->appendChild(*++ii);
+  expression->appendChild(*++ii);
+  while (function->childNodes().size() > 1) {
+    function->removeChild(--function->childNodes().end());
+  }
+  Node* assignment = (new NodeAssignment(ASSIGN, function->lineno()))
+    ->appendChild(new NodeIdentifier(name->name(), name->lineno()))
+    ->appendChild(expression);
+  delete body->removeChild(function->position());
+  return assignment;
+}
+
+void PackageClosure::process(NodeProgram* root) {
+  _locals = 0;
+  _skipped = NULL;
+  if (root->childNodes().empty()) {
+    _skipped = "nothing to rename";
+    return;
+  }
+  root->buildIndex();
+  const ScopeTree* tree = root->scopes();
+  const scope_t& global = tree->scope(0);
+  if (global.contains_eval || global.contains_with) {
+    _skipped = "it uses eval or with";
+    return;
+  }
+
+  set<string> exported(_exports);
+  window_properties(root, tree, exported);
+
+  // Exported declarations have to be top-level statements to be rewritten
+  Node* body = root->childNodes().front();
+  set<Node*> rewrite;
+  vector<string> declared_exports;
+  for (vector<unsigned int>::const_iterator ii = global.bindings.begin(); ii != global.bindings.end(); ++ii) {
+    const binding_t& binding = tree->binding(*ii);
+    const string& name = tree->name(binding.name);
+    if (binding.type == BINDING_UNDECLARED) {
+      if (name == "arguments") {
+        _skipped = "it uses arguments outside of a function";
+        return;
+      }
+      continue;
+    }
+    if (!exported.count(name)) {
+      ++_locals;
+      continue;
+    }
+    declared_exports.push_back(name);
+    for (vector<NodeIdentifier*>::const_iterator jj = binding.references.begin(); jj != binding.references.end(); ++jj) {
+      Node* declaration = declaration_of(*jj);
+      if (declaration == NULL) {
+        continue;
+      }
+      if (declaration->parent() != body) {
+        _locals = 0;
+        _skipped = "an exported name is declared inside a statement";
+        return;
+      }
+      rewrite.insert(declaration);
+    }
+  }
+  if (_locals == 0) {
+    _skipped = "nothing to rename";
+    return;
+  }
+
+  bool uses_this = false;
+  const vector<Node*>& these = root->index()->nodes(NODE_THIS);
+  for (vector<Node*>::const_iterator ii = these.begin(); ii != these.end() && !uses_this; ++ii) {
+    uses_this = (*ii)->enclosingFunction() == NULL;
+  }
+
+  // Rewrite the exported declarations. Functions go first, in the order they
+  // were declared, but after any directives like "use strict".
+  vector<Node*> functions;
+  node_list_t::iterator ii = body->childNodes().begin();
+  while (ii != body->childNodes().end()) {
+    Node* statement = *ii++;
+    if (!rewrite.count(statement)) {
+      continue;
+    }
+    if (statement->kind() == NODE_VAR_DECLARATION) {
+      split_var(statement, body, exported);
+    } else {
+      functions.push_back(export_function(statement, body));
+    }
+  }
+  node_list_t::iterator start = body->childNodes().begin();
+  while (start != body->childNodes().end() && (*start)->kind() == NODE_STRING_LITERAL) {
+    ++start;
+  }
+  for (vector<Node*>::iterator ii = functions.begin(); ii != functions.end(); ++ii) {
+    body->insertBefore(*ii, start);
+  }
+
+  // (function(){ body })() or (function(){ body }).call(this)
+  unsigned int lineno = body->lineno();
+  node_list_t::iterator slot = root->childNodes().begin();
+  Node* function = (new NodeFunctionExpression(lineno))
+    ->appendChild(NULL)
+    ->appendChild(new NodeArgList(lineno))
+    ->appendChild(body);
+  Node* callee = (new NodeParenthetical(lineno))->appendChild(function);
+  Node* args = new NodeArgList(lineno);
+  if (uses_this) {
+    callee = (new NodeStaticMemberExpression(lineno))
+      ->appendChild(callee)
+      ->appendChild(new NodeIdentifier("call", lineno));
+    args->appendChild(new NodeThis(lineno));
+  }
+  Node* program = new NodeStatementList(lineno);
+  if (!declared_exports.empty()) {
+    Node* var = new NodeVarDeclaration(false, lineno);
+    for (vector<string>::iterator ii = declared_exports.begin(); ii != declared_exports.end(); ++ii) {
+      var->appendChild(new NodeIdentifier(*ii, lineno));
+    }
+    program->appendChild(var);
+  }
+  program->appendChild((new NodeFunctionCall(lineno))->appendChild(callee)->appendChild(args));
+  root->replaceChild(program, slot);
+}
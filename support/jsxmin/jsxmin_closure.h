@@ -0,0 +1,51 @@
+#ifndef _JSXMIN_CLOSURE_H_
+#define _JSXMIN_CLOSURE_H_
+
+#include "abstract_compiler_pass.h"
+
+#include <set>
+#include <string>
+
+namespace fbjs {
+class NodeProgram;
+}
+
+// Wraps a package in a function that's called right away, so that the vars
+// and functions it declares at the top level become locals the renamer can
+// shorten instead of globals it has to leave alone:
+//
+//   var helper = ...; function f() {...}   =>   (function(){var a=...;function b(){...}})();
+//
+// A top-level name stays global if it's exported: either listed when the
+// pass is made, or used as `window.name` somewhere in the package. Exported
+// names are declared outside the function, and inside it their declarations
+// turn into plain assignments:
+//
+//   var JX = {}; function f() {...}   =>   var JX;(function(){JX={};function a(){...}})();
+//
+// The package is left as it is when wrapping couldn't work or wouldn't help:
+//   1. it uses eval or with anywhere, since the code they run could refer to
+//      any top-level name by what it was called in the source;
+//   2. it refers to `arguments` outside of any function;
+//   3. an exported name is declared somewhere other than a top-level
+//      statement, like the head of a for loop;
+//   4. there's nothing at the top level left to rename.
+class PackageClosure : public fbjs::AbstractCompilerPass {
+public:
+  // `exports` lists top-level names that must stay global, comma separated.
+  PackageClosure(const std::string& exports);
+  virtual ~PackageClosure() {}
+  virtual void process(fbjs::NodeProgram* root);
+
+  // Top-level names the last call to process() made local, or 0 if it left
+  // the package alone. If so, skipped() says why.
+  unsigned int locals() const { return _locals; }
+  const char* skipped() const { return _skipped; }
+
+private:
+  std::set<std::string> _exports;
+  unsigned int _locals;
+  const char* _skipped;
+};
+
+#endif
@@ -0,0 +1,249 @@
+#include "libfbjs/node.hpp"
+
+#include "jsxmin_compression.h"
+
+#include <algorithm>
+#include <typeinfo>
+#include <vector>
+#include <zlib.h>
+
+// Output tweaks that favor the gzip'd size of a package over its raw size.
+//
+// Deflate replaces repeated byte sequences with back-references, so the more
+// often the same few bytes show up within its 32KB window the better. The
+// renamer helps with this by naming locals in declaration order (so the first
+// argument of every function is `a`), and this pass takes care of the choices
+// the source leaves open:
+//
+// Quoting:
+//   'foo' and "foo" are the same string. Every literal is rewritten to use
+//   whichever quote the program already uses most, unless that would need
+//   more escapes than it has now.
+//
+// Property order:
+//   Object literal keys are generally observable through for-in, so they're
+//   only reordered where Javelin looks them up by name: the spec passed to
+//   JX.install() or JX.createClass(). Even then, we only sort when every value
+//   is a literal or function expression so evaluation order can't change
+//   anything. Sorting the members and statics maps as well was tried, but it
+//   splits up related methods and costs more than it saves.
+
+using namespace std;
+using namespace fbjs;
+
+#define for_nodes(p, i) \
+  for (node_list_t::iterator i  = (p)->childNodes().begin(); \
+                             i != (p)->childNodes().end(); \
+                           ++i)
+
+typedef pair<string, Node*> keyed_property_t;
+
+struct compare_property_keys {
+  bool operator()(const keyed_property_t& a, const keyed_property_t& b) const {
+    return a.first < b.first;
+  }
+};
+
+// Returns true if evaluating this expression can't have side effects.
+static bool is_constant(Node* node) {
+  if (node == NULL) {
+    return true;
+  }
+  const type_info& type = typeid(*node);
+  if (type == typeid(NodeNumericLiteral) ||
+      type == typeid(NodeStringLiteral) ||
+      type == typeid(NodeRegexLiteral) ||
+      type == typeid(NodeBooleanLiteral) ||
+      type == typeid(NodeNullLiteral) ||
+      type == typeid(NodeFunctionExpression)) {
+    return true;
+  }
+  if (type == typeid(NodeObjectLiteralProperty)) {
+    return is_constant(node->childNodes().back());
+  }
+  if (type == typeid(NodeObjectLiteral) || type == typeid(NodeArrayLiteral)) {
+    for_nodes(node, ii) {
+      if (!is_constant(*ii)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+// Rewrites a string literal to use `quote`. Returns false if it already does,
+// or if the rewritten literal would be longer.
+static bool requote(const string& literal, char quote, string& result) {
+  char current = literal[0];
+  if (current == quote) {
+    return false;
+  }
+  result = quote;
+  for (size_t ii = 1; ii < literal.size() - 1; ++ii) {
+    char c = literal[ii];
+    if (c == '\\') {
+      char next = literal[++ii];
+      if (next != current) {
+        result += c;
+      }
+      result += next;
+    } else {
+      if (c == quote) {
+        result += '\\';
+      }
+      result += c;
+    }
+  }
+  result += quote;
+  return result.size() <= literal.size();
+}
+
+void CompressionNormalization::process(NodeProgram* root) {
+  int single = 0, dbl = 0;
+  if (root->index() != NULL) {
+    count_quotes(root->index()->nodes(NODE_STRING_LITERAL), single, dbl);
+  } else {
+    count_quotes(root, single, dbl);
+  }
+  _quote = dbl > single ? '"' : '\'';
+  normalize(root);
+}
+
+// Both walks below use an explicit stack rather than recursing, since generated
+// code can nest deep enough to overflow the C stack.
+void CompressionNormalization::count_quotes(Node* node, int& single, int& dbl) {
+  vector<Node*> pending(1, node);
+  while (!pending.empty()) {
+    node = pending.back();
+    pending.pop_back();
+    if (node == NULL) {
+      continue;
+    }
+    if (typeid(*node) == typeid(NodeStringLiteral)) {
+      if (node->render(RENDER_NONE)[0] == '"') {
+        ++dbl;
+      } else {
+        ++single;
+      }
+      continue;
+    }
+    pending.insert(pending.end(), node->childNodes().begin(),
+                   node->childNodes().end());
+  }
+}
+
+// Same count off the parser's index, without walking the tree
+void CompressionNormalization::count_quotes(const vector<Node*>& strings, int& single, int& dbl) {
+  for (vector<Node*>::const_iterator ii = strings.begin(); ii != strings.end(); ++ii) {
+    if ((*ii)->render(RENDER_NONE)[0] == '"') {
+      ++dbl;
+    } else {
+      ++single;
+    }
+  }
+}
+
+void CompressionNormalization::normalize(Node* node) {
+  vector<Node*> pending(1, node);
+  while (!pending.empty()) {
+    node = pending.back();
+    pending.pop_back();
+    if (node == NULL) {
+      continue;
+    }
+
+    if (typeid(*node) == typeid(NodeFunctionCall) && is_class_spec_call(node)) {
+      sort_properties(node->childNodes().back()->childNodes().back());
+    }
+
+    node_list_t::iterator ii = node->childNodes().begin();
+    while (ii != node->childNodes().end()) {
+      Node* child = *ii;
+      string requoted;
+      if (child != NULL && typeid(*child) == typeid(NodeStringLiteral) &&
+          requote(child->render(RENDER_NONE).c_str(), _quote, requoted)) {
+        node->replaceChild(
+          new NodeStringLiteral(requoted, true, child->lineno()), ii++);
+        delete child;
+      } else {
+        pending.push_back(child);
+        ++ii;
+      }
+    }
+  }
+}
+
+// Sorts the properties of an object literal by key, if it's safe to.
+void CompressionNormalization::sort_properties(Node* object_literal) {
+  if (!is_constant(object_literal)) {
+    return;
+  }
+
+  vector<keyed_property_t> properties;
+  for_nodes(object_literal, ii) {
+    properties.push_back(keyed_property_t(
+      (*ii)->childNodes().front()->render(RENDER_NONE).c_str(), *ii));
+  }
+
+  // Duplicate keys keep their relative order, so the last one still wins.
+  vector<keyed_property_t> sorted(properties);
+  stable_sort(sorted.begin(), sorted.end(), compare_property_keys());
+  bool changed = false;
+  for (size_t ii = 0; ii < sorted.size(); ++ii) {
+    if (sorted[ii].second != properties[ii].second) {
+      changed = true;
+      break;
+    }
+  }
+  if (!changed) {
+    return;
+  }
+
+  while (!object_literal->empty()) {
+    object_literal->removeChild(object_literal->childNodes().begin());
+  }
+  for (size_t ii = 0; ii < sorted.size(); ++ii) {
+    object_literal->appendChild(sorted[ii].second);
+  }
+}
+
+// Checks for JX.install(name, {...}) or JX.createClass({...}).
+bool CompressionNormalization::is_class_spec_call(Node* call) {
+  Node* callee = call->childNodes().front();
+  Node* args = call->childNodes().back();
+  if (typeid(*callee) != typeid(NodeStaticMemberExpression) ||
+      args == NULL || args->empty()) {
+    return false;
+  }
+  Node* spec = args->childNodes().back();
+  if (spec == NULL || typeid(*spec) != typeid(NodeObjectLiteral)) {
+    return false;
+  }
+  string name = callee->render(RENDER_NONE).c_str();
+  return name == "JX.install" || name == "JX.createClass";
+}
+
+void compressed_size(const string& data, size_t& raw, size_t& gzip) {
+  raw = data.size();
+  gzip = 0;
+
+  z_stream stream;
+  stream.zalloc = Z_NULL;
+  stream.zfree = Z_NULL;
+  stream.opaque = Z_NULL;
+
+  // 15 + 16 window bits asks zlib for a gzip wrapper rather than a zlib one.
+  if (deflateInit2(&stream, 9, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return;
+  }
+  vector<unsigned char> out(deflateBound(&stream, data.size()) + 32);
+  stream.next_in = (Bytef*)data.data();
+  stream.avail_in = data.size();
+  stream.next_out = &out[0];
+  stream.avail_out = out.size();
+  if (deflate(&stream, Z_FINISH) == Z_STREAM_END) {
+    gzip = stream.total_out;
+  }
+  deflateEnd(&stream);
+}
@@ -0,0 +1,40 @@
+#ifndef _JSXMIN_COMPRESSION_H_
+#define _JSXMIN_COMPRESSION_H_
+
+#include "abstract_compiler_pass.h"
+
+#include <string>
+#include <vector>
+
+namespace fbjs {
+class NodeProgram;
+class Node;
+}
+
+// Rewrites a program so that it deflates better. None of these make the raw
+// output any smaller; they make it more repetitive:
+//   1. string literals use the same quote character wherever that doesn't
+//      cost an extra escape;
+//   2. class specs passed to JX.install() and JX.createClass() list their
+//      keys in sorted order.
+class CompressionNormalization : public fbjs::AbstractCompilerPass {
+public:
+  CompressionNormalization() : _quote('\'') {}
+  virtual ~CompressionNormalization() {}
+  virtual void process(fbjs::NodeProgram* root);
+
+private:
+  void count_quotes(fbjs::Node* node, int& single, int& dbl);
+  void count_quotes(const std::vector<fbjs::Node*>& strings, int& single, int& dbl);
+  void normalize(fbjs::Node* node);
+  void sort_properties(fbjs::Node* object_literal);
+  bool is_class_spec_call(fbjs::Node* call);
+
+  // Quote character string literals are normalized to.
+  char _quote;
+};
+
+// Returns the raw and gzip compressed size of some output.
+void compressed_size(const std::string& data, size_t& raw, size_t& gzip);
+
+#endif
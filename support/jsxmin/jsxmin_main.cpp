@@ -1,39 +1,185 @@
+#include "libfbjs/lint.hpp"
 #include "libfbjs/node.hpp"
 
+#include "jsxmin_closure.h"
 #include "jsxmin_renaming.h"
 #include "jsxmin_reduction.h"
+#include "jsxmin_compression.h"
+#include "pass_manager.h"
 
 #include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace fbjs;
 
-static void jsxminify(NodeProgram* root, string &replacements) {
+static void jsxminify(NodeProgram* root, string &replacements, bool gzip,
+                      bool stats, unsigned int threads, bool closure,
+                      const string& exports, const vector<string>& packages,
+                      RenameMap* names, RenameMap* member_names, string& error) {
+  PassManager passes;
+
   // Code reduction should happen at the first.
   CodeReduction code_reduction;
   code_reduction.replacements = replacements;
-  code_reduction.process(root);
+  code_reduction.schedule(passes);
+
+  // Turns top-level names into locals before they're renamed.
+  PackageClosure package_closure(exports);
+  if (closure) {
+    passes.add(&package_closure);
+  }
 
   // Starts in the global scope.
-  VariableRenaming variable_renaming;
-  variable_renaming.process(root);
+  VariableRenaming variable_renaming(/* in_declaration_order */ gzip, threads, names);
+  passes.add(&variable_renaming);
 
-/*
-  PropertyRenaming property_renaming;
-  property_renaming.process(root);
-*/
+  // Private members of JX.install() classes, when we know every package
+  // they could be used from.
+  MemberRenaming member_renaming(packages, member_names);
+  if (!packages.empty()) {
+    passes.add(&member_renaming);
+  }
+
+  CompressionNormalization compression_normalization;
+  if (gzip) {
+    passes.add(&compression_normalization);
+  }
+
+  passes.process(root);
+  error = member_renaming.error();
+  if (stats) {
+    fprintf(stderr, "%u passes in %u tree walks, %u saved by fusion\n",
+      passes.passes(), passes.traversals(), passes.saved());
+    if (closure && package_closure.skipped() != NULL) {
+      fprintf(stderr, "not wrapped in a closure: %s\n", package_closure.skipped());
+    } else if (closure) {
+      fprintf(stderr, "wrapped in a closure, %u top-level names made local\n",
+        package_closure.locals());
+    }
+    if (variable_renaming.kept() > 0) {
+      fprintf(stderr, "%u variables kept their names for eval or with, about %lu bytes\n",
+        variable_renaming.kept(), variable_renaming.kept_bytes());
+    }
+    if (!packages.empty() && error.empty()) {
+      fprintf(stderr, "%u private members renamed\n", member_renaming.renamed());
+    }
+  }
 }
 
 int main(int argc, char* argv[]) {
   try {
 
-    string replacements(argc > 1 ? argv[1] : "");
+    // Usage: jsxmin [--gzip] [--closure] [--export=a,b] [--members=a.js,b.js]
+    //              [--names=FILE] [--member-names=FILE] [--lint[=NAME]]
+    //              [--stats] [--max-line=N] [--threads=N] [replacements]
+    //   --gzip        favor compressed size over raw size
+    //   --closure     wrap the package in a function and rename its top-level
+    //                 names, see jsxmin_closure.h
+    //   --export=a,b  top-level names --closure keeps global
+    //   --members=a.js,b.js
+    //                 rename private members of JX.install() classes, given
+    //                 the sources of every package built with this one
+    //   --names=FILE  give local variables the names they had in the build
+    //                 that last wrote FILE where they can, and write this
+    //                 build's names to it, see jsxmin_rename_map.h
+    //   --member-names=FILE
+    //                 the same for --members, with one FILE for the whole set
+    //   --lint[=NAME] print lint about the input to stderr, calling it NAME,
+    //                 the same as support/jslint does
+    //   --stats       print pass and output size stats to stderr
+    //   --max-line=N  break lines once they pass N bytes
+    //   --threads=N   rename functions on N threads, default one per CPU
+    string replacements;
+    bool gzip = false;
+    bool stats = false;
+    bool closure = false;
+    string exports;
+    vector<string> packages;
+    string names_path, member_names_path;
+    const char* lint_name = NULL;
+    unsigned int max_line = 0;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int ii = 1; ii < argc; ++ii) {
+      if (strcmp(argv[ii], "--gzip") == 0) {
+        gzip = true;
+      } else if (strcmp(argv[ii], "--closure") == 0) {
+        closure = true;
+      } else if (strncmp(argv[ii], "--export=", 9) == 0) {
+        exports = argv[ii] + 9;
+      } else if (strncmp(argv[ii], "--members=", 10) == 0) {
+        for (char* file = strtok(argv[ii] + 10, ","); file != NULL; file = strtok(NULL, ",")) {
+          packages.push_back(file);
+        }
+      } else if (strncmp(argv[ii], "--names=", 8) == 0) {
+        names_path = argv[ii] + 8;
+      } else if (strncmp(argv[ii], "--member-names=", 15) == 0) {
+        member_names_path = argv[ii] + 15;
+      } else if (strcmp(argv[ii], "--lint") == 0) {
+        lint_name = "stdin";
+      } else if (strncmp(argv[ii], "--lint=", 7) == 0) {
+        lint_name = argv[ii] + 7;
+      } else if (strncmp(argv[ii], "--max-line=", 11) == 0) {
+        max_line = atoi(argv[ii] + 11);
+      } else if (strncmp(argv[ii], "--threads=", 10) == 0) {
+        threads = atoi(argv[ii] + 10);
+      } else if (strcmp(argv[ii], "--stats") == 0) {
+        stats = true;
+      } else {
+        replacements = argv[ii];
+      }
+    }
+
+    RenameMap names, member_names;
+    string error;
+    if (!names_path.empty() && !names.load(names_path)) {
+      error = "can't read " + names_path;
+    } else if (!member_names_path.empty() && !member_names.load(member_names_path)) {
+      error = "can't read " + member_names_path;
+    }
+    if (!error.empty()) {
+      fprintf(stderr, "jsxmin: %s\n", error.c_str());
+      return 1;
+    }
 
     // Create a node.
-    NodeProgram root(stdin);
-    jsxminify(&root, replacements);
+    NodeProgram root(stdin, PARSE_INDEX);
+
+    // Lint comes from the scopes of the code as it's written, before any
+    // passes change it.
+    if (lint_name != NULL) {
+      vector<lint_t> lints = lint(*root.scopes());
+      for (vector<lint_t>::iterator ii = lints.begin(); ii != lints.end(); ++ii) {
+        fprintf(stderr, "%s:%u: %s [%s]\n",
+          lint_name, ii->lineno, ii->message.c_str(), lintName(ii->type));
+      }
+    }
+    jsxminify(&root, replacements, gzip, stats, threads > 1 ? threads : 1,
+              closure, exports, packages,
+              names_path.empty() ? NULL : &names,
+              member_names_path.empty() ? NULL : &member_names, error);
+    if (error.empty() && !names_path.empty() && !names.save(names_path)) {
+      error = "can't write " + names_path;
+    }
+    if (error.empty() && !member_names_path.empty() && !member_names.save(member_names_path)) {
+      error = "can't write " + member_names_path;
+    }
+    if (!error.empty()) {
+      fprintf(stderr, "jsxmin: %s\n", error.c_str());
+      return 1;
+    }
+
+    rope_t output = root.render(RENDER_PARALLEL, max_line);
+    cout << output.c_str();
 
-    cout << root.render(RENDER_NONE).c_str();
+    if (stats) {
+      size_t raw, compressed;
+      compressed_size(output.c_str(), raw, compressed);
+      fprintf(stderr, "%lu bytes, %lu bytes gzipped\n",
+        (unsigned long)raw, (unsigned long)compressed);
+    }
 
   } catch (ParseException ex) {
     fprintf(stderr, "parsing error: %s\n", ex.what());
@@ -29,25 +29,45 @@
 using namespace fbjs;
 using namespace std;
 
+CodeReduction::~CodeReduction() {
+  for (size_t ii = 0; ii < _patterns.size(); ++ii) {
+    delete _patterns[ii];
+  }
+}
+
 void CodeReduction::process(NodeProgram* root) {
+  PassManager passes;
+  schedule(passes);
+  passes.process(root);
+}
+
+void CodeReduction::schedule(PassManager& passes) {
   // If there is no well-formed replacement pattern in command line option,
   // skip the process. A well-formed pattern string has the format of
   // "pattern1:replacement1,pattern2:replacement2".
   // For example, --replace "__DEV__:0,Util.isDevelopmentEnvironment():false"
   // specifies that replaces __DEV__ by 0
   // and replaces Util.isDevelopmentEnvironment() by false.
-  if (parse_patterns(replacements)) {
+  if (_patterns.empty() && parse_patterns(replacements)) {
     for (replacement_t::iterator it = _replacement.begin();
                                  it != _replacement.end();
                                  ++it) {
-      NodeProgram left(it->first.c_str());
-      NodeProgram right(it->second.c_str());
-      replace(root, find_expression(&left), find_expression(&right));
+      _patterns.push_back(new ReplacePattern(it->first, it->second));
     }
   }
 
-  ReductionWalker walker;
-  walker.walk(root);
+  // Patterns are applied in order, each to the whole tree. One that could
+  // match around what an earlier one matches or leaves behind has to wait
+  // for it to finish.
+  for (size_t ii = 0; ii < _patterns.size(); ++ii) {
+    passes.add(_patterns[ii]);
+    for (size_t jj = 0; jj < ii; ++jj) {
+      if (_patterns[jj]->affects(*_patterns[ii])) {
+        passes.after(_patterns[ii], _patterns[jj]);
+      }
+    }
+  }
+  passes.add(&_reduction);
 }
 
 // Format: orig1 : new1, orig2: new2, parsed as
@@ -80,31 +100,8 @@ bool CodeReduction::parse_patterns(const string& input) {
   return _replacement.size() != 0;
 }
 
-// Replaces instances of `needle` in `haystack` with `rep`.
-Node* CodeReduction::replace(Node* haystack, const Node* needle,
-                             const Node* rep) {
-  if (haystack == NULL) {
-    return NULL;
-  } else if (*haystack == *needle) {
-    delete haystack;
-    return rep->clone();
-  }
-
-  Node* tmp;
-  node_list_t::iterator ii = haystack->childNodes().begin();
-  while (ii != haystack->childNodes().end()) {
-    tmp = replace(*ii, needle, rep);
-    if (tmp != (*ii)) {
-      haystack->replaceChild(tmp, ii++);
-    } else {
-      ++ii;
-    }
-  }
-  return haystack;
-}
-
 // Finds the first NodeExpression in a Node tree
-const NodeExpression* CodeReduction::find_expression(const Node* node) {
+static const NodeExpression* find_expression(const Node* node) {
   if (dynamic_cast<const NodeExpression*>(node) != NULL) {
     return static_cast<const NodeExpression*>(node);
   }
@@ -117,3 +114,47 @@ const NodeExpression* CodeReduction::find_expression(const Node* node) {
   }
   return NULL;
 }
+
+// Checks if any node below `haystack` is equal to `needle`
+static bool contains(const Node* haystack, const Node* needle) {
+  for (node_list_t::iterator ii = haystack->childNodes().begin(); ii != haystack->childNodes().end(); ++ii) {
+    if (*ii != NULL && (**ii == *needle || contains(*ii, needle))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+ReplacePattern::ReplacePattern(const string& needle, const string& rep) :
+    LocalPass(ENTER),
+    _needle_program(new NodeProgram(needle.c_str())),
+    _rep_program(new NodeProgram(rep.c_str())) {
+  _needle = find_expression(_needle_program);
+  _rep = find_expression(_rep_program);
+}
+
+ReplacePattern::~ReplacePattern() {
+  delete _needle_program;
+  delete _rep_program;
+}
+
+// Replaces instances of `needle` with `rep`.
+Node* ReplacePattern::enter(Node* node, Node* parent, bool& remove) {
+  if (_needle != NULL && _rep != NULL && *node == *_needle) {
+    return _rep->clone();
+  }
+  return node;
+}
+
+bool ReplacePattern::affects(const ReplacePattern& later) const {
+  if (later._needle == NULL) {
+    return false;
+  }
+  return (_needle != NULL && contains(later._needle, _needle)) ||
+    (_rep != NULL && contains(later._needle, _rep));
+}
+
+Node* ReductionPass::leave(Node* node, Node* parent, bool& remove) {
+  ReductionWalker walker;
+  return walker.visitAfterChildren(node, parent, remove);
+}
@@ -2,7 +2,10 @@
 #define _JSXMIN_REDUCTION_H_
 
 #include "abstract_compiler_pass.h"
+#include "pass_manager.h"
 #include <map>
+#include <string>
+#include <vector>
 
 typedef std::map<std::string, std::string> replacement_t;
 
@@ -12,17 +15,46 @@ class NodeExpression;
 class Node;
 }
 
+// Replaces every expression equal to one pattern with a copy of another.
+class ReplacePattern : public fbjs::LocalPass {
+public:
+  ReplacePattern(const std::string& needle, const std::string& rep);
+  virtual ~ReplacePattern();
+  virtual fbjs::Node* enter(fbjs::Node* node, fbjs::Node* parent, bool& remove);
+
+  // Could running this pattern first change what `later` matches?
+  bool affects(const ReplacePattern& later) const;
+
+private:
+  fbjs::NodeProgram* _needle_program;
+  fbjs::NodeProgram* _rep_program;
+  const fbjs::NodeExpression* _needle;
+  const fbjs::NodeExpression* _rep;
+};
+
+// Folds constant conditions and simplifies what's left; see ReductionWalker.
+class ReductionPass : public fbjs::LocalPass {
+public:
+  ReductionPass() : fbjs::LocalPass(LEAVE) {}
+  virtual fbjs::Node* leave(fbjs::Node* node, fbjs::Node* parent, bool& remove);
+};
+
 class CodeReduction : public fbjs::AbstractCompilerPass {
 public:
   CodeReduction() {}
-  virtual ~CodeReduction() {}
+  virtual ~CodeReduction();
   virtual void process(fbjs::NodeProgram* root);
+
+  // Adds the replacements followed by the reduction to a pipeline, so they
+  // can share a traversal with each other and the passes around them.
+  void schedule(fbjs::PassManager& passes);
+
   std::string replacements;
 private:
-  fbjs::Node* replace(fbjs::Node* haystack, const fbjs::Node* needle, const fbjs::Node* rep);
-  const fbjs::NodeExpression* find_expression(const fbjs::Node* node);
   bool parse_patterns(const std::string& s);
   replacement_t _replacement;
+  std::vector<ReplacePattern*> _patterns;
+  ReductionPass _reduction;
 };
 
 #endif
@@ -0,0 +1,53 @@
+#include "jsxmin_rename_map.h"
+
+#include <errno.h>
+#include <stdio.h>
+
+using namespace std;
+
+bool RenameMap::load(const string& path) {
+  _previous.clear();
+  FILE* file = fopen(path.c_str(), "r");
+  if (file == NULL) {
+    return errno == ENOENT;
+  }
+  string line;
+  int c;
+  while ((c = fgetc(file)) != EOF) {
+    if (c != '\n') {
+      line.push_back(c);
+      continue;
+    }
+    size_t first = line.find('\t');
+    size_t second = first == string::npos ? string::npos : line.find('\t', first + 1);
+    if (second != string::npos) {
+      _previous[make_pair(line.substr(0, first), line.substr(first + 1, second - first - 1))] =
+        line.substr(second + 1);
+    }
+    line.clear();
+  }
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+bool RenameMap::save(const string& path) const {
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == NULL) {
+    return false;
+  }
+  for (names_t::const_iterator ii = _current.begin(); ii != _current.end(); ++ii) {
+    fprintf(file, "%s\t%s\t%s\n",
+      ii->first.first.c_str(), ii->first.second.c_str(), ii->second.c_str());
+  }
+  return fclose(file) == 0;
+}
+
+const string* RenameMap::previous(const string& context, const string& name) const {
+  names_t::const_iterator ii = _previous.find(make_pair(context, name));
+  return ii == _previous.end() ? NULL : &ii->second;
+}
+
+void RenameMap::record(const string& context, const string& name, const string& new_name) {
+  _current[make_pair(context, name)] = new_name;
+}
@@ -0,0 +1,45 @@
+#ifndef _JSXMIN_RENAME_MAP_H_
+#define _JSXMIN_RENAME_MAP_H_
+
+#include <map>
+#include <string>
+#include <utility>
+
+// The names a build gave to things, kept from one build to the next so the
+// renamer can give them the same names again. Otherwise adding one variable
+// to a function can shift the names of everything after it, and the whole
+// package comes out different.
+//
+// Each name is recorded under a context saying where it was declared, like a
+// function or the members of a class, since the same name means different
+// things in different places. The file is text, one name a line:
+//
+//   <context> TAB <name> TAB <new name>
+//
+// Only what the last build recorded is saved, so names that are gone from
+// the code drop out of the file.
+class RenameMap {
+public:
+  RenameMap() {}
+
+  // Reads the names an earlier build saved. A file that isn't there is the
+  // same as an empty one, since the first build has nothing to go on.
+  // Returns false if it's there and can't be read.
+  bool load(const std::string& path);
+
+  // Writes the names recorded since the map was loaded, in sorted order.
+  bool save(const std::string& path) const;
+
+  // The name `name` got in `context` the last time, or NULL.
+  const std::string* previous(const std::string& context, const std::string& name) const;
+
+  // Notes the name `name` got in `context` this time.
+  void record(const std::string& context, const std::string& name, const std::string& new_name);
+
+private:
+  typedef std::map<std::pair<std::string, std::string>, std::string> names_t;
+  names_t _previous;
+  names_t _current;
+};
+
+#endif
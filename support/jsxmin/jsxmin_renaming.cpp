@@ -1,6 +1,9 @@
 #include "jsxmin_renaming.h"
 
+#include <algorithm>
 #include <assert.h>
+#include <ctype.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <iostream>
 
@@ -30,9 +33,11 @@
 //        |__ parent -> {'a' -> 'a', 'func' -> 'func'} ( *global_scope* )
 //
 //   When renaming variables in func_scope, it starts with shortest name 'a',
-//   but it first has to loopup the scope chain to see if 'a' is used as
-//   new name in the current scope and parent scopes. In this case, 'a' is
-//   not available, so 'b' is choosed as new name of 'foo'. The result
+//   but it first has to check that 'a' isn't the new name of a variable from
+//   the scope chain that func refers to, in its own body or in functions
+//   nested in it. In this case, func refers to the global 'a', so 'a' is not
+//   available, and 'b' is choosed as new name of 'foo'. Had func not referred
+//   to it, 'foo' could have been renamed to 'a' and shadowed it. The result
 //   local scope looks like following:
 //     func_scope => {'foo' -> 'b', 'bar' -> 'c', 'gee' => 'd'}
 //         |__ parent -> {'a' -> 'a', 'func' -> 'func'} ( *global_scope* )
@@ -45,6 +50,18 @@
 //   When entering a function, a new scope is created with the current scope
 //   as its parent scope.
 //
+//   Within a scope, the most used variables get new names first, so when a
+//   function runs out of one letter names it's the rarely used ones that get
+//   longer names.
+//
+//   Code run by eval can refer by name to anything declared in the function
+//   that calls it or in the ones around that, so those variables keep their
+//   names. An identifier in the body of a with statement could be a property
+//   of its object instead of the variable it looks like, so the variables
+//   referred to there, from outside the body, keep theirs too. Everything
+//   else is still renamed, functions nested in those included, but no new
+//   name can be one of the kept ones anywhere they're seen.
+//
 // Global variable renaming and property renaming:
 //   We use naming convention that name starting with exact one '_' is private
 //   to the file or the class (function). Also this naming convention is
@@ -62,6 +79,8 @@
 //   another constructor function (as its parent class) that adds a property
 //   named _bar. Because the child and parent constructor functions are in
 //   different files, both can get renamed to the same name.
+//   MemberRenaming is the safe version for classes made with JX.install(),
+//   which it can follow from one file to the next.
 
 using namespace std;
 using namespace fbjs;
@@ -71,66 +90,138 @@ using namespace fbjs;
                              i != (p)->childNodes().end(); \
                            ++i)
 
-#define WARN(format, args...)
-
 // ---- NameFactory -----
-string NameFactory::next() {
-  string result = _prefix + _current;
-  bool found = false;
-  // move to the next
-  for (size_t i = 0; i < _current.size(); i++) {
-    char c = _current[i] + 1;
-    if (c <= 'z') {
-      _current[i] = c;
-      found = true;
-      break;
+const char* const NameFactory::DEFAULT_ALPHABET =
+  "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ$_0123456789";
+
+void NameFactory::set_alphabet(const string& alphabet) {
+  _alphabet = alphabet;
+  _leading.clear();
+  for (string::iterator ii = _alphabet.begin(); ii != _alphabet.end(); ++ii) {
+    if (_prefix.empty() ? !isdigit(*ii) : *ii != '_') {
+      _leading.push_back(*ii);
     }
   }
-  if (!found) {
-    _current.push_back('a');
-  }
-  return result;
 }
 
-// ---- Scope ----
-void Scope::declare(string name) {
-  _replacement[name] = name;
+// The nth name is n written in a base as big as the alphabet, except that the
+// first character only has the leading characters to choose from.
+string NameFactory::next() {
+  string name;
+  do {
+    unsigned long n = _next++;
+    name = _prefix;
+    name.push_back(_leading[n % _leading.size()]);
+    n /= _leading.size();
+    while (n > 0) {
+      --n;
+      name.push_back(_alphabet[n % _alphabet.size()]);
+      n /= _alphabet.size();
+    }
+  } while (is_reserved_keyword(name));
+  return name;
 }
 
-string Scope::new_name(string orig_name) {
-  rename_t::iterator it = _replacement.find(orig_name);
-  if (it != _replacement.end()) {
-    return it->second;
-  }
-  if (!_parent) {
-    return orig_name;
+struct compare_frequencies {
+  const vector<long>& counts;
+  explicit compare_frequencies(const vector<long>& counts) : counts(counts) {}
+  bool operator()(char left, char right) const {
+    return counts[(unsigned char)left] > counts[(unsigned char)right];
   }
+};
 
-  return _parent->new_name(orig_name);
+string NameFactory::alphabet(const vector<long>& counts) {
+  string alphabet(DEFAULT_ALPHABET);
+  stable_sort(alphabet.begin(), alphabet.end(), compare_frequencies(counts));
+  return alphabet;
 }
 
-bool Scope::declared(string name) {
-  if (_replacement.find(name) != _replacement.end()) {
-    return true;
+// ---- Scope ----
+Scope::Scope(Scope* parent) :
+    _atoms(parent == NULL ? NULL : parent->_atoms),
+    _parent(parent) {}
+
+void Scope::declare(const string& name, unsigned int uses /* = 0 */) {
+  atom_t atom = _atoms->intern(name);
+  if (_replacement.find(atom) == AtomMap::NONE) {
+    _declared.push_back(atom);
+  }
+  _replacement.set(atom, atom);
+  unsigned int previous = _uses.find(atom);
+  _uses.set(atom, previous == AtomMap::NONE ? uses : previous + uses);
+}
+
+string Scope::new_name(const string& orig_name) {
+  atom_t atom = _atoms->find(orig_name);
+  if (atom != AtomTable::NONE) {
+    for (Scope* scope = this; scope != NULL; scope = scope->_parent) {
+      atom_t new_name = scope->_replacement.find(atom);
+      if (new_name != AtomMap::NONE) {
+        return _atoms->name(new_name);
+      }
+    }
   }
+  return orig_name;
+}
 
-  if (!_parent) {
+bool Scope::declared(const string& name) {
+  atom_t atom = _atoms->find(name);
+  if (atom == AtomTable::NONE) {
     return false;
   }
+  for (Scope* scope = this; scope != NULL; scope = scope->_parent) {
+    if (scope->_replacement.find(atom) != AtomMap::NONE) {
+      return true;
+    }
+  }
+  return false;
+}
+
+struct compare_names {
+  const AtomTable* atoms;
+  explicit compare_names(const AtomTable* atoms) : atoms(atoms) {}
+  bool operator()(atom_t left, atom_t right) const {
+    return atoms->name(left) < atoms->name(right);
+  }
+};
 
-  return _parent->declared(name);
+atom_list_t Scope::sorted_names() {
+  atom_list_t names(_declared);
+  sort(names.begin(), names.end(), compare_names(_atoms));
+  return names;
 }
 
-bool Scope::in_use(string name) {
-  if (_new_names.find(name) != _new_names.end()) {
-    return true;
+struct compare_uses {
+  const AtomMap* uses;
+  explicit compare_uses(const AtomMap* uses) : uses(uses) {}
+  bool operator()(atom_t left, atom_t right) const {
+    return uses->find(left) > uses->find(right);
   }
-  if (!_parent) {
-    return false;
+};
+
+atom_list_t Scope::ranked_names() {
+  atom_list_t names = sorted_names();
+  stable_sort(names.begin(), names.end(), compare_uses(&_uses));
+  return names;
+}
+
+void Scope::prefer_names(const RenameMap& names, const string& context) {
+  for (atom_list_t::iterator it = _declared.begin(); it != _declared.end(); it++) {
+    const string* previous = names.previous(context, _atoms->name(*it));
+    if (previous != NULL && is_identifier(*previous)) {
+      _preferred.set(*it, _atoms->intern(*previous));
+    }
   }
-  return _parent->in_use(name);
 }
 
+void Scope::record_names(RenameMap& names, const string& context) {
+  for (atom_list_t::iterator it = _declared.begin(); it != _declared.end(); it++) {
+    atom_t new_name = _replacement.find(*it);
+    if (new_name != *it) {
+      names.record(context, _atoms->name(*it), _atoms->name(new_name));
+    }
+  }
+}
 
 void Scope::dump() {
   int indention = 0;
@@ -140,45 +231,68 @@ void Scope::dump() {
     parent = parent->_parent;
   }
 
-  for (rename_t::iterator it = _replacement.begin();
-       it != _replacement.end();
-       it++) {
+  atom_list_t names = sorted_names();
+  for (atom_list_t::iterator it = names.begin(); it != names.end(); it++) {
     cout<<"//";
     for (int i = 0; i < indention; i++) {
       cout << " ";
     }
-    cout << it->first.c_str() << " -> " << it->second.c_str() << "\n";
+    cout << _atoms->name(*it) << " -> "
+         << _atoms->name(_replacement.find(*it)) << "\n";
   }
 }
 
-bool LocalScope::need_rename(const string& name) {
-  return name != "event";
+bool LocalScope::need_rename(atom_t name) {
+  return _kept.find(name) == AtomMap::NONE && _atoms->name(name) != "event";
+}
+
+bool LocalScope::renames_any() {
+  for (atom_list_t::iterator it = _declared.begin(); it != _declared.end(); it++) {
+    if (need_rename(*it)) {
+      return true;
+    }
+  }
+  return false;
 }
 
 void LocalScope::rename_vars() {
-  NameFactory factory;
-
-  for (rename_t::iterator it = _replacement.begin();
-       it != _replacement.end();
-       it++) {
-    string var_name = it->first;
-    string new_name = it->second;
-    if (need_rename(var_name)) {
-      new_name = factory.next();
-      while (_parent->in_use(new_name)) {
-        new_name = factory.next();
-      }
+  NameFactory factory("", _alphabet);
+
+  // Variables that keep their names, or get the ones they had before, take
+  // them first so that nothing else can.
+  atom_list_t names = _in_declaration_order ? _declared : ranked_names();
+  atom_list_t rest;
+  for (atom_list_t::iterator it = names.begin(); it != names.end(); it++) {
+    atom_t var_name = *it;
+    atom_t preferred = _preferred.find(var_name);
+    if (!need_rename(var_name)) {
+      rename_internal(var_name, var_name);
+    } else if (preferred != AtomMap::NONE && !in_use(preferred)) {
+      rename_internal(var_name, preferred);
+    } else {
+      rest.push_back(var_name);
     }
-    rename_internal(var_name, new_name);
+  }
+  for (atom_list_t::iterator it = rest.begin(); it != rest.end(); it++) {
+    atom_t new_name = _atoms->intern(factory.next());
+    while (in_use(new_name)) {
+      new_name = _atoms->intern(factory.next());
+    }
+    rename_internal(*it, new_name);
   }
 }
 
 // ---- GlobalScope ----
 GlobalScope::GlobalScope(bool rename_private) : Scope(NULL) {
+  this->_atoms = new AtomTable();
   this->_rename_private = rename_private;
   this->_name_factory.set_prefix("_");
 }
 
+GlobalScope::~GlobalScope() {
+  delete this->_atoms;
+}
+
 bool GlobalScope::need_rename(const string& name) {
   return this->_rename_private &&
          name.length() > 1 &&
@@ -187,15 +301,14 @@ bool GlobalScope::need_rename(const string& name) {
 }
 
 void GlobalScope::rename_vars() {
-  for (rename_t::iterator it = _replacement.begin();
-       it != _replacement.end();
-       it++) {
-    string var_name = it->first;
-    string new_name = it->second;
-    if (need_rename(var_name)) {
-      new_name = _name_factory.next();
-      while (this->in_use(new_name)) {
-        new_name = _name_factory.next();
+  atom_list_t names = sorted_names();
+  for (atom_list_t::iterator it = names.begin(); it != names.end(); it++) {
+    atom_t var_name = *it;
+    atom_t new_name = _replacement.find(var_name);
+    if (need_rename(_atoms->name(var_name))) {
+      new_name = _atoms->intern(_name_factory.next());
+      while (in_use(new_name)) {
+        new_name = _atoms->intern(_name_factory.next());
       }
     }
     rename_internal(var_name, new_name);
@@ -203,15 +316,25 @@ void GlobalScope::rename_vars() {
 }
 
 void GlobalScope::rename_var(const string& var_name) {
-  string new_name = _name_factory.next();
-  while (this->in_use(new_name)) {
-    new_name = _name_factory.next();
+  atom_t new_name = _atoms->intern(_name_factory.next());
+  while (in_use(new_name)) {
+    new_name = _atoms->intern(_name_factory.next());
   }
-  rename_internal(var_name, new_name);
+  rename_internal(_atoms->intern(var_name), new_name);
 }
 
 // ----- VariableRenaming ----
-VariableRenaming::VariableRenaming() {
+VariableRenaming::VariableRenaming(bool in_declaration_order /* = false */,
+                                   unsigned int threads /* = 1 */,
+                                   RenameMap* names /* = NULL */) :
+    _scope_tree(NULL),
+    _in_declaration_order(in_declaration_order),
+    _alphabet(NameFactory::DEFAULT_ALPHABET),
+    _kept_count(0),
+    _kept_bytes(0),
+    _rename_map(names),
+    _threads(threads),
+    _next_binding(0) {
   this->_global_scope = new GlobalScope(/* rename_globals */ false);
 }
 
@@ -220,188 +343,882 @@ VariableRenaming::~VariableRenaming() {
 }
 
 void VariableRenaming::process(NodeProgram* root) {
-
-  // Collect all symbols in the file scope
-  build_scope(root, this->_global_scope);
+  // Declarations and references come from the program's scope analysis,
+  // which needs an index to keep it current. Renaming puts it out of date,
+  // but by then everything has been read from it.
+  root->buildIndex();
+  _scope_tree = root->scopes();
+  find_kept(root);
+
+  // Collect all symbols in the file scope. Globals that are used without
+  // being declared can't be given to anything else either.
+  declare_bindings(this->_global_scope, 0);
+  const scope_t& global = _scope_tree->scope(0);
+  for (vector<unsigned int>::const_iterator ii = global.bindings.begin(); ii != global.bindings.end(); ++ii) {
+    const binding_t& binding = _scope_tree->binding(*ii);
+    if (binding.type == BINDING_UNDECLARED) {
+      this->_global_scope->reserve(_scope_tree->name(binding.name));
+    }
+  }
   this->_global_scope->rename_vars();
+  choose_alphabet(root);
+  if (_rename_map != NULL) {
+    name_scopes();
+  }
+  rename_scopes();
+
+  // Every identifier belongs to one binding, so threads renaming different
+  // bindings never touch the same node.
+  _next_binding = 0;
+  vector<pthread_t> workers;
+  for (unsigned int ii = 1; ii < _threads; ++ii) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, run_worker, this) == 0) {
+      workers.push_back(thread);
+    }
+  }
+  run_worker(this);
+  for (vector<pthread_t>::iterator ii = workers.begin(); ii != workers.end(); ++ii) {
+    pthread_join(*ii, NULL);
+  }
 
-  // Starts in the global scope.
-  minify(root, this->_global_scope);
+  // Catch clauses that share the scope of the function around them go
+  // first, while it can still be told apart from theirs.
+  for (size_t ii = _scopes.size(); ii-- > 1; ) {
+    if (_scope_tree->scope(ii).type == SCOPE_FUNCTION ||
+        _scopes[ii] != _scopes[function_of(ii)]) {
+      delete _scopes[ii];
+    }
+    delete _self_scopes[ii];
+  }
+  _scopes.clear();
+  _self_scopes.clear();
+  _kept.clear();
+  _kept_in.clear();
 }
 
-void VariableRenaming::minify(Node* node, Scope* scope) {
-  if (node == NULL) {
-    return;
-  }
+// A scope always comes after its parent in the tree, so going through them
+// in order names each function after the ones around it.
+void VariableRenaming::rename_scopes() {
+  _scopes.assign(_scope_tree->scopeCount(), NULL);
+  _self_scopes.assign(_scope_tree->scopeCount(), NULL);
+  _scopes[0] = this->_global_scope;
+  for (size_t ii = 1; ii < _scopes.size(); ++ii) {
+    const scope_t& scope = _scope_tree->scope(ii);
+    Scope* parent = _scopes[scope.parent];
+    if (scope.type == SCOPE_CATCH) {
+      if (shares_catch(ii)) {
+        _scopes[ii] = _scopes[function_of(ii)];
+      } else {
+        _scopes[ii] = rename_inner_scope(parent, scope.parent, ii, _contexts.empty() ? "" : _contexts[ii]);
+      }
+      continue;
+    }
 
-  if (typeid(*node) == typeid(NodeObjectLiteralProperty)) {
-    //  For {prop: value}, we can't rename the property with local scope rules.
-    minify(node->childNodes().back(), scope);
+    // A function expression's own name is seen inside it, but not outside,
+    // so it's named in a scope of its own between the two. At the top level
+    // it stays global in old versions of IE, so it's left alone.
+    for (vector<unsigned int>::const_iterator jj = scope.bindings.begin(); jj != scope.bindings.end(); ++jj) {
+      if (_scope_tree->binding(*jj).type == BINDING_FUNCTION_NAME && !parent->is_global()) {
+        parent = _self_scopes[ii] = rename_inner_scope(parent, scope.parent, ii,
+          _contexts.empty() ? "" : _contexts[ii] + "/(name)");
+      }
+    }
 
-  } else if (typeid(*node) == typeid(NodeStaticMemberExpression)) {
-    // a.b case, cannot rename _b
-    minify(node->childNodes().front(), scope);
+    // Variables from outside the function that it refers to already have
+    // their new names, since the scopes around it went first. Everything
+    // else can be shadowed. The function's own name and `arguments` are
+    // seen inside it too, without being declared.
+    LocalScope* local = new LocalScope(parent, _alphabet, _in_declaration_order);
+    declare_bindings(local, ii);
+    for (vector<unsigned int>::const_iterator jj = scope.free.begin(); jj != scope.free.end(); ++jj) {
+      local->avoid(new_name(*jj));
+    }
 
-  } else if (typeid(*node) == typeid(NodeIdentifier)) {
-    NodeIdentifier* n = static_cast<NodeIdentifier*>(node);
-    string name = n->name();
-    if (scope->declared(name)) {
-      n->rename(scope->new_name(name));
+    // Only names given out here can capture the kept ones, and in a function
+    // eval can see there are none.
+    if (local->renames_any()) {
+      for (vector<unsigned int>::const_iterator jj = _kept_in[ii].begin(); jj != _kept_in[ii].end(); ++jj) {
+        local->avoid(_scope_tree->name(_scope_tree->binding(*jj).name));
+      }
+    }
+    for (vector<unsigned int>::const_iterator jj = scope.bindings.begin(); jj != scope.bindings.end(); ++jj) {
+      binding_enum type = _scope_tree->binding(*jj).type;
+      if (type == BINDING_FUNCTION_NAME || type == BINDING_ARGUMENTS) {
+        local->avoid(new_name(*jj));
+      }
+    }
+    if (_rename_map != NULL) {
+      local->prefer_names(*_rename_map, _contexts[ii]);
     }
+    local->rename_vars();
+    if (_rename_map != NULL) {
+      local->record_names(*_rename_map, _contexts[ii]);
+    }
+    _scopes[ii] = local;
+  }
+}
 
-  } else if ( (typeid(*node) == typeid(NodeFunctionDeclaration) ||
-               typeid(*node) == typeid(NodeFunctionExpression))) {
-    if (!function_has_with_or_eval(node)){
-      node_list_t::iterator func = node->childNodes().begin();
+// Name of an object literal's key
+static bool literal_key(Node* key, string& name) {
+  if (key->kind() == NODE_IDENTIFIER) {
+    name = static_cast<NodeIdentifier*>(key)->name();
+    return true;
+  }
+  if (key->kind() == NODE_STRING_LITERAL) {
+    name = static_cast<NodeStringLiteral*>(key)->unquoted_value();
+    return true;
+  }
+  return false;
+}
 
-      // Skip function name.
-      ++func;
+// `a.b.c` for a chain of names, or "" for anything else
+static string dotted_name(Node* node) {
+  if (node == NULL) {
+    return "";
+  }
+  if (node->kind() == NODE_IDENTIFIER) {
+    return static_cast<NodeIdentifier*>(node)->name();
+  }
+  if (node->kind() == NODE_THIS) {
+    return "this";
+  }
+  if (node->kind() == NODE_STATIC_MEMBER_EXPRESSION) {
+    string object = dotted_name(node->childNodes().front());
+    if (!object.empty()) {
+      return object + "." + static_cast<NodeIdentifier*>(node->childNodes().back())->name();
+    }
+  }
+  return "";
+}
 
-      // Create a new local scope for the function using current scope
-      // as parent. Then add arguments to the local scope and build
-      // scope for variables declared in the function.
-      LocalScope child_scope(scope);
+// What a function goes by: its own name, what it's assigned to, or the keys
+// of the object literals it's in, after the string that starts the call
+// they're passed to. In JX.install('URI', {members: {setPath: function()
+// {...}}}) that's URI.members.setPath.
+static string function_label(Node* function) {
+  Node* name = function->childNodes().front();
+  if (name != NULL) {
+    return static_cast<NodeIdentifier*>(name)->name();
+  }
+  string label;
+  Node* node = function;
+  while (node != NULL && node->parent() != NULL) {
+    Node* parent = node->parent();
+    string key;
+    if (parent->kind() == NODE_OBJECT_LITERAL_PROPERTY &&
+        parent->childNodes().back() == node &&
+        literal_key(parent->childNodes().front(), key)) {
+      label = label.empty() ? key : key + "." + label;
+      node = parent->parent();
+      continue;
+    }
+    if (parent->kind() == NODE_ASSIGNMENT && parent->childNodes().back() == node) {
+      key = dotted_name(parent->childNodes().front());
+    } else if (parent->kind() == NODE_ARG_LIST &&
+               parent->childNodes().front() != NULL &&
+               parent->childNodes().front()->kind() == NODE_STRING_LITERAL) {
+      key = static_cast<NodeStringLiteral*>(parent->childNodes().front())->unquoted_value();
+    }
+    if (!key.empty()) {
+      label = label.empty() ? key : key + "." + label;
+    }
+    break;
+  }
+  return label;
+}
 
-      // First, add all the arguments to scope.
-      for_nodes(*func, arg) {
-        NodeIdentifier *arg_node = static_cast<NodeIdentifier*>(*arg);
-        child_scope.declare(arg_node->name());
+// A scope's context is its parent's followed by its own label, numbered if
+// the parent has more than one scope by that label. Only the scopes around
+// a function and the ones before it with the same label decide what it's
+// called, so code added elsewhere doesn't change it.
+void VariableRenaming::name_scopes() {
+  _contexts.assign(_scope_tree->scopeCount(), "");
+  map<pair<unsigned int, string>, unsigned int> seen;
+  for (size_t ii = 1; ii < _contexts.size(); ++ii) {
+    const scope_t& scope = _scope_tree->scope(ii);
+    string label = scope.type == SCOPE_CATCH ? "catch" : function_label(scope.node);
+    if (label.empty()) {
+      label = "function";
+    }
+    for (string::iterator jj = label.begin(); jj != label.end(); ++jj) {
+      if (*jj == '\t' || *jj == '\n') {
+        *jj = ' ';
       }
+    }
+    unsigned int count = seen[make_pair(scope.parent, label)]++;
+    if (count > 0) {
+      char number[16];
+      snprintf(number, sizeof(number), "#%u", count);
+      label += number;
+    }
+    _contexts[ii] = _contexts[scope.parent] + "/" + label;
+  }
+}
 
-      // Now, look ahead and find all the local variable declarations.
-      build_scope(*(++func), &child_scope);
-
-      // Build renaming map in local scope
-      child_scope.rename_vars();
+// Counts the characters of the program as it is, then takes out the names
+// that are about to be renamed, since they won't be in the output.
+void VariableRenaming::choose_alphabet(NodeProgram* root) {
+  vector<long> counts(256, 0);
+  rope_t output = root->render(RENDER_PARALLEL);
+  const char* text = output.c_str();
+  for (size_t ii = 0; ii < output.size(); ++ii) {
+    ++counts[(unsigned char)text[ii]];
+  }
 
-      //  Finally, recurse with the new scope.
-      //  Function name can only be renamed in the parent scope.
-      for_nodes(node, ii) {
-        if (ii == node->childNodes().begin()) {
-          minify(*ii, scope);
-        } else {
-          minify(*ii, &child_scope);
-        }
-      }
+  for (size_t ii = 0; ii < _scope_tree->bindingCount(); ++ii) {
+    if (!renamable(ii) || _kept[ii]) {
+      continue;
     }
-    // If the function has with and eval, don't attempt to rename code further.
-  } else {
-    for_nodes(node, ii) {
-      minify(*ii, scope);
+    const binding_t& binding = _scope_tree->binding(ii);
+    const string& name = _scope_tree->name(binding.name);
+    for (string::const_iterator jj = name.begin(); jj != name.end(); ++jj) {
+      counts[(unsigned char)*jj] -= binding.references.size();
     }
   }
+  _alphabet = NameFactory::alphabet(counts);
 }
 
-
-// Iterate through all child nodes and find if it contains with or eval
-// statement, it also recursively check sub functions.
-bool VariableRenaming::function_has_with_or_eval(Node* node) {
-  if (node == NULL) {
+// Declarations in the global scope, and catch clauses that share its names,
+// stay as they are. So does a function expression's own name at the top
+// level, see rename_scopes().
+bool VariableRenaming::renamable(unsigned int index) {
+  const binding_t& binding = _scope_tree->binding(index);
+  if (binding.type == BINDING_ARGUMENTS || binding.type == BINDING_UNDECLARED ||
+      _scope_tree->name(binding.name) == "event") {
     return false;
   }
+  unsigned int scope = binding.type == BINDING_FUNCTION_NAME ?
+    _scope_tree->scope(binding.scope).parent : binding.scope;
+  return function_of(scope) != 0;
+}
+
+// A direct call to eval sees every variable in the scope it's in and the
+// ones around it. A with statement's body sees the variables it refers to
+// through its object, which could have a property by the same name, or by
+// the name the variable would be given. Variables declared in functions and
+// catch clauses inside the body come first, so only the ones from outside
+// are kept.
+void VariableRenaming::find_kept(NodeProgram* root) {
+  _kept.assign(_scope_tree->bindingCount(), false);
+  _kept_in.assign(_scope_tree->scopeCount(), vector<unsigned int>());
+  _kept_count = 0;
+  _kept_bytes = 0;
+  const scope_t& global = _scope_tree->scope(0);
+  if (!global.contains_eval && !global.contains_with) {
+    return;
+  }
 
-  for_nodes(node, ii) {
-    Node* child = *ii;
-    if (child == NULL) {
+  for (size_t ii = 0; ii < _scope_tree->scopeCount(); ++ii) {
+    if (!_scope_tree->scope(ii).has_eval) {
       continue;
     }
+    for (unsigned int jj = ii; jj != ScopeTree::NONE; jj = _scope_tree->scope(jj).parent) {
+      const scope_t& seen = _scope_tree->scope(jj);
+      for (vector<unsigned int>::const_iterator kk = seen.bindings.begin(); kk != seen.bindings.end(); ++kk) {
+        _kept[*kk] = true;
+      }
+    }
+  }
 
-    if (typeid(*child) == typeid(NodeWith)) {
-      WARN("function has 'with' statement at line %d\n", child->lineno());
-      return true;
+  if (global.contains_with) {
+    vector<Node*> pending(1, root);
+    while (!pending.empty()) {
+      Node* node = pending.back();
+      pending.pop_back();
+      if (node == NULL) {
+        continue;
+      }
+      if (node->kind() == NODE_WITH) {
+        vector<Node*> body(1, node->childNodes().back());
+        vector<unsigned int> references;
+        set<unsigned int> inner;
+        while (!body.empty()) {
+          Node* inside = body.back();
+          body.pop_back();
+          if (inside == NULL) {
+            continue;
+          }
+          unsigned int scope = _scope_tree->scopeOf(inside);
+          if (scope != ScopeTree::NONE) {
+            inner.insert(scope);
+          }
+          if (inside->kind() == NODE_IDENTIFIER) {
+            unsigned int binding = _scope_tree->resolve(static_cast<NodeIdentifier*>(inside));
+            if (binding != ScopeTree::NONE) {
+              references.push_back(binding);
+            }
+          }
+          for_nodes(inside, ii) {
+            body.push_back(*ii);
+          }
+        }
+        for (vector<unsigned int>::iterator ii = references.begin(); ii != references.end(); ++ii) {
+          if (!inner.count(_scope_tree->binding(*ii).scope)) {
+            _kept[*ii] = true;
+          }
+        }
+      }
+      for_nodes(node, ii) {
+        pending.push_back(*ii);
+      }
+    }
+  }
+
+  for (size_t ii = 0; ii < _kept.size(); ++ii) {
+    if (!_kept[ii] || !renamable(ii)) {
+      continue;
+    }
+    const binding_t& binding = _scope_tree->binding(ii);
+    for (unsigned int jj = binding.scope; jj != ScopeTree::NONE; jj = _scope_tree->scope(jj).parent) {
+      _kept_in[jj].push_back(ii);
     }
+    ++_kept_count;
+    _kept_bytes += (_scope_tree->name(binding.name).length() - 1) * binding.references.size();
+  }
+}
 
-    NodeFunctionCall* call = dynamic_cast<NodeFunctionCall*>(child);
-    if (call != NULL) {
-      NodeIdentifier* iden = dynamic_cast<NodeIdentifier*>(call->childNodes().front());
-      if (iden != NULL && iden->name() == "eval") {
-        WARN("function uses 'eval' at line %d\n", call->lineno());
-        return true;
+// A catch clause or a function expression's name, which is the only thing
+// declared in its scope. `names` is the function or catch clause whose
+// references from outside it the name mustn't capture.
+//
+// Old versions of IE also declare these in the function around them, where
+// they'd hide whatever else is called that. So they stay clear of every name
+// in use in that function and the catch clauses between, the ones given to
+// the others like them in it included.
+LocalScope* VariableRenaming::rename_inner_scope(Scope* parent, unsigned int around,
+                                                 unsigned int names, const string& context) {
+  LocalScope* local = new LocalScope(parent, _alphabet, _in_declaration_order);
+  const scope_t& scope = _scope_tree->scope(names);
+  if (scope.type == SCOPE_CATCH) {
+    declare_bindings(local, names);
+  } else {
+    for (vector<unsigned int>::const_iterator ii = scope.bindings.begin(); ii != scope.bindings.end(); ++ii) {
+      const binding_t& binding = _scope_tree->binding(*ii);
+      if (binding.type == BINDING_FUNCTION_NAME) {
+        local->declare(_scope_tree->name(binding.name), binding.references.size());
+        if (_kept[*ii]) {
+          local->keep(_scope_tree->name(binding.name));
+        }
       }
     }
+  }
+  if (local->renames_any()) {
+    for (vector<unsigned int>::const_iterator ii = _kept_in[names].begin(); ii != _kept_in[names].end(); ++ii) {
+      local->avoid(_scope_tree->name(_scope_tree->binding(*ii).name));
+    }
+  }
+  for (unsigned int ii = around; ; ii = _scope_tree->scope(ii).parent) {
+    local->avoid_all(_scopes[ii]);
+    if (_scope_tree->scope(ii).type != SCOPE_CATCH) {
+      break;
+    }
+  }
+  for (vector<unsigned int>::const_iterator ii = scope.free.begin(); ii != scope.free.end(); ++ii) {
+    local->avoid(new_name(*ii));
+  }
+  if (_rename_map != NULL) {
+    local->prefer_names(*_rename_map, context);
+  }
+  local->rename_vars();
+  if (_rename_map != NULL) {
+    local->record_names(*_rename_map, context);
+  }
 
-    if ( (typeid(*child) == typeid(NodeFunctionDeclaration) ||
-          typeid(*child) == typeid(NodeFunctionExpression)) &&
-         function_has_with_or_eval(child) ) {
-      return true;
-      // Don't check the current child node again if it is a function
-      // declaration or expression.
+  // The function around already has its names, so this one is only marked
+  // in use there, for the catch clauses and function names after it.
+  Scope* function = _scopes[function_of(around)];
+  binding_enum own = scope.type == SCOPE_CATCH ? BINDING_CATCH : BINDING_FUNCTION_NAME;
+  for (vector<unsigned int>::const_iterator ii = scope.bindings.begin(); ii != scope.bindings.end(); ++ii) {
+    const binding_t& binding = _scope_tree->binding(*ii);
+    if (binding.type == own) {
+      function->avoid(local->new_name(_scope_tree->name(binding.name)));
+    }
+  }
+  return local;
+}
+
+unsigned int VariableRenaming::function_of(unsigned int tree_scope) {
+  while (_scope_tree->scope(tree_scope).type == SCOPE_CATCH) {
+    tree_scope = _scope_tree->scope(tree_scope).parent;
+  }
+  return tree_scope;
+}
 
-    } else if (function_has_with_or_eval(child)) {
+// A catch variable is named along with the function around it when that's
+// the global scope, since old versions of IE would make it a global, or when
+// the function declares the same name, since `var e` in `catch (e) {...}`
+// refers to both.
+bool VariableRenaming::shares_catch(unsigned int tree_scope) {
+  unsigned int function = function_of(tree_scope);
+  if (function == 0) {
+    return true;
+  }
+  const scope_t& scope = _scope_tree->scope(tree_scope);
+  const scope_t& around = _scope_tree->scope(function);
+  for (vector<unsigned int>::const_iterator ii = scope.bindings.begin(); ii != scope.bindings.end(); ++ii) {
+    unsigned int other = around.names.find(_scope_tree->binding(*ii).name);
+    if (other != AtomMap::NONE && _scope_tree->binding(other).type != BINDING_FUNCTION_NAME &&
+        _scope_tree->binding(other).type != BINDING_ARGUMENTS) {
       return true;
     }
   }
   return false;
 }
 
-void VariableRenaming::build_scope(Node *node, Scope* scope) {
+void VariableRenaming::declare_bindings(Scope* scope, unsigned int tree_scope) {
+  vector<unsigned int> pending(1, tree_scope);
+  while (!pending.empty()) {
+    unsigned int current = pending.back();
+    const scope_t& declared = _scope_tree->scope(current);
+    pending.pop_back();
+
+    // Catch clauses in a function are walked for the ones that share its
+    // names, but the others are named on their own.
+    if (current != tree_scope && !shares_catch(current)) {
+      for (vector<unsigned int>::const_reverse_iterator ii = declared.children.rbegin(); ii != declared.children.rend(); ++ii) {
+        if (_scope_tree->scope(*ii).type == SCOPE_CATCH) {
+          pending.push_back(*ii);
+        }
+      }
+      continue;
+    }
+    for (vector<unsigned int>::const_iterator ii = declared.bindings.begin(); ii != declared.bindings.end(); ++ii) {
+      const binding_t& binding = _scope_tree->binding(*ii);
+
+      // A function expression's own name has a scope of its own, and
+      // `arguments` can't be renamed at all.
+      if (binding.type != BINDING_FUNCTION_NAME &&
+          binding.type != BINDING_ARGUMENTS &&
+          binding.type != BINDING_UNDECLARED) {
+        scope->declare(_scope_tree->name(binding.name), binding.references.size());
+        if (_kept[*ii]) {
+          scope->keep(_scope_tree->name(binding.name));
+        }
+      }
+    }
 
-  if (node == NULL) {
-    return;
+    // A catch clause's own scope only has its variable in it
+    if (declared.type == SCOPE_CATCH && current == tree_scope) {
+      continue;
+    }
+    for (vector<unsigned int>::const_reverse_iterator ii = declared.children.rbegin(); ii != declared.children.rend(); ++ii) {
+      if (_scope_tree->scope(*ii).type == SCOPE_CATCH) {
+        pending.push_back(*ii);
+      }
+    }
   }
+}
 
-  if (typeid(*node) == typeid(NodeFunctionExpression)) {
+string VariableRenaming::new_name(unsigned int index) {
+  const binding_t& binding = _scope_tree->binding(index);
+  Scope* scope = binding.type == BINDING_FUNCTION_NAME ?
+    _self_scopes[binding.scope] : _scopes[binding.scope];
+  const string& name = _scope_tree->name(binding.name);
+  if (scope == NULL || !scope->declared(name)) {
+    return name;
+  }
+  return scope->new_name(name);
+}
+
+void VariableRenaming::rename_binding(unsigned int index) {
+  const binding_t& binding = _scope_tree->binding(index);
+  string new_name = this->new_name(index);
+  if (new_name == _scope_tree->name(binding.name)) {
     return;
   }
+  for (vector<NodeIdentifier*>::const_iterator ii = binding.references.begin(); ii != binding.references.end(); ++ii) {
+    (*ii)->rename(new_name);
+  }
+}
 
-  if (typeid(*node) == typeid(NodeFunctionDeclaration)) {
-    NodeIdentifier* decl_name =
-        dynamic_cast<NodeIdentifier*>(node->childNodes().front());
-    if (decl_name) {
-      scope->declare(decl_name->name());
+void* VariableRenaming::run_worker(void* renaming) {
+  VariableRenaming* self = static_cast<VariableRenaming*>(renaming);
+  size_t count = self->_scope_tree->bindingCount();
+  while (true) {
+    size_t first = __sync_fetch_and_add(&self->_next_binding, 64);
+    if (first >= count) {
+      break;
+    }
+    for (size_t ii = first; ii < first + 64 && ii < count; ++ii) {
+      self->rename_binding(ii);
     }
-    return;
   }
+  return NULL;
+}
 
-  if (typeid(*node) == typeid(NodeVarDeclaration)) {
-    for_nodes(node, ii) {
-      NodeIdentifier *n = dynamic_cast<NodeIdentifier*>(*ii);
-      if (!n) {
-        n = dynamic_cast<NodeIdentifier*>((*ii)->childNodes().front());
+
+// ----- MemberRenaming -----
+// Which objects a member is used on comes from `this`: in a class's
+// constructor and members it's an instance, and in its statics it's the class.
+// So is `this` in a function passed to JX.bind(this, ...) from one of those.
+// Outside of these, only JX.Name._member can be told apart, or the same
+// through a variable that's only ever set to JX.Name. A member used
+// anywhere else, as a key in some other object literal, or that shows up in
+// a string literal could be on anything, so it isn't renamed anywhere. Its
+// name isn't handed out either.
+//
+// Classes are the same family when one extends the other, and their
+// instances share members from all of them. A class that extends one we
+// can't see could get members from anywhere, so nothing used on its
+// instances is renamed.
+//
+// New names start with one underscore as well. Every private name that
+// isn't renamed is kept out of the new names, so they can't collide with
+// anything.
+
+static bool is_private(const string& name) {
+  return name.length() > 1 && name[0] == '_' && name[1] != '_';
+}
+
+// JX.<name>, with `name` returned
+static bool is_jx_member(Node* node, string& name) {
+  if (node == NULL || node->kind() != NODE_STATIC_MEMBER_EXPRESSION) {
+    return false;
+  }
+  Node* object = node->childNodes().front();
+  if (object == NULL || object->kind() != NODE_IDENTIFIER ||
+      static_cast<NodeIdentifier*>(object)->name() != "JX") {
+    return false;
+  }
+  name = static_cast<NodeIdentifier*>(node->childNodes().back())->name();
+  return true;
+}
+
+// A variable that's only ever set to JX.<name> where it's declared, with
+// `name` returned
+static bool is_jx_alias(const ScopeTree* tree, Node* node, string& name) {
+  if (node == NULL || node->kind() != NODE_IDENTIFIER) {
+    return false;
+  }
+  unsigned int index = tree->resolve(static_cast<NodeIdentifier*>(node));
+  if (index == ScopeTree::NONE) {
+    return false;
+  }
+  const binding_t& binding = tree->binding(index);
+  if (binding.type != BINDING_VAR || binding.writes.size() != 1 ||
+      binding.writes.front() != binding.declaration) {
+    return false;
+  }
+  Node* declarator = binding.declaration->parent();
+  return declarator != NULL && declarator->kind() == NODE_ASSIGNMENT &&
+    is_jx_member(declarator->childNodes().back(), name);
+}
+
+// JX.install('Name', {...}), with the name and spec returned
+static bool is_install_call(Node* call, string& name, Node*& spec) {
+  string callee;
+  if (!is_jx_member(call->childNodes().front(), callee) || callee != "install") {
+    return false;
+  }
+  node_list_t& args = call->childNodes().back()->childNodes();
+  if (args.size() < 2 ||
+      args.front() == NULL || args.front()->kind() != NODE_STRING_LITERAL ||
+      *++args.begin() == NULL || (*++args.begin())->kind() != NODE_OBJECT_LITERAL) {
+    return false;
+  }
+  name = static_cast<NodeStringLiteral*>(args.front())->unquoted_value();
+  spec = *++args.begin();
+  return true;
+}
+
+MemberRenaming::MemberRenaming(const vector<string>& packages,
+                               RenameMap* names /* = NULL */) :
+    _packages(packages), _rename_map(names), _renamed(0) {}
+
+void MemberRenaming::find_classes(NodeProgram* root) {
+  const vector<Node*>& calls = root->index()->nodes(NODE_FUNCTION_CALL);
+  for (vector<Node*>::const_iterator ii = calls.begin(); ii != calls.end(); ++ii) {
+    string name;
+    Node* spec;
+    if (!is_install_call(*ii, name, spec)) {
+      continue;
+    }
+    string extends;
+    for_nodes(spec, jj) {
+      string key;
+      Node* value = (*jj)->childNodes().back();
+      if (literal_key((*jj)->childNodes().front(), key) && key == "extend") {
+        extends = value != NULL && value->kind() == NODE_STRING_LITERAL ?
+          static_cast<NodeStringLiteral*>(value)->unquoted_value() : "?";
       }
-      scope->declare(n->name());
     }
-    return;
+    _extends[name] = extends;
   }
+}
 
-  // Special case for try ... catch(e) ...
-  // Treat e as a local variable.
-  if (typeid(*node) == typeid(NodeTry)) {
-    // second child is the catch variable, either null of a node identifier.
-    node_list_t::iterator it = node->childNodes().begin();
-    ++it;
-    NodeIdentifier* var = dynamic_cast<NodeIdentifier*>(*it);
-    if (var) {
-      scope->declare(var->name());
+// Instances of a class are named after the family's base class
+const string* MemberRenaming::instance_domain(const string& name) {
+  string base = name;
+  for (size_t depth = 0; depth <= _extends.size(); ++depth) {
+    map<string, string>::iterator ii = _extends.find(base);
+    if (ii == _extends.end()) {
+      return NULL;
     }
-    return;
+    if (ii->second.empty()) {
+      return &*_domains.insert("instance of " + base).first;
+    }
+    base = ii->second;
   }
+  return NULL;
+}
+
+const string* MemberRenaming::static_domain(const string& name) {
+  if (_extends.find(name) == _extends.end()) {
+    return NULL;
+  }
+  return &*_domains.insert("class " + name).first;
+}
+
+void MemberRenaming::find_uses(NodeProgram* root, vector<member_use_t>& uses) {
+  const ScopeTree* tree = root->scopes();
+  member_walk_t start = {root, NULL, NULL};
+  vector<member_walk_t> pending(1, start);
+  while (!pending.empty()) {
+    member_walk_t walk = pending.back();
+    pending.pop_back();
+    Node* node = walk.node;
+    if (node == NULL) {
+      continue;
+    }
+    const string* self = walk.self;
+    member_use_t use = {NULL, "", NULL};
+
+    switch (node->kind()) {
+      case NODE_FUNCTION_DECLARATION:
+      case NODE_FUNCTION_EXPRESSION:
+        self = walk.method;
+        break;
+
+      case NODE_FUNCTION_CALL: {
+        string name;
+        Node* spec;
+        if (is_install_call(node, name, spec)) {
+          find_spec_uses(name, spec, self, pending, uses);
+          continue;
+        }
+
+        // JX.bind(this, function() {...}, ...) keeps `this`
+        node_list_t& args = node->childNodes().back()->childNodes();
+        if (is_jx_member(node->childNodes().front(), name) && name == "bind" &&
+            args.size() >= 2 && args.front() != NULL &&
+            args.front()->kind() == NODE_THIS) {
+          for (node_list_t::reverse_iterator ii = args.rbegin(); ii != args.rend(); ++ii) {
+            member_walk_t arg = {*ii, self, self};
+            pending.push_back(arg);
+          }
+          continue;
+        }
+        break;
+      }
+
+      case NODE_STATIC_MEMBER_EXPRESSION: {
+        Node* object = node->childNodes().front();
+        NodeIdentifier* member = static_cast<NodeIdentifier*>(node->childNodes().back());
+        string name;
+        if (is_private(member->name())) {
+          if (object != NULL && object->kind() == NODE_THIS) {
+            use.domain = self;
+          } else if (is_jx_member(object, name) || is_jx_alias(tree, object, name)) {
+            use.domain = static_domain(name);
+          }
+          use.name = member->name();
+          use.identifier = member;
+          uses.push_back(use);
+        }
+        member_walk_t walk_object = {object, self, NULL};
+        pending.push_back(walk_object);
+        continue;
+      }
+
+      case NODE_OBJECT_LITERAL_PROPERTY: {
+        Node* key = node->childNodes().front();
+        if (literal_key(key, use.name) && is_private(use.name)) {
+          use.identifier = key->kind() == NODE_IDENTIFIER ? static_cast<NodeIdentifier*>(key) : NULL;
+          uses.push_back(use);
+        }
+        member_walk_t value = {node->childNodes().back(), self, NULL};
+        pending.push_back(value);
+        continue;
+      }
+
+      case NODE_STRING_LITERAL:
+        use.name = static_cast<NodeStringLiteral*>(node)->unquoted_value();
+        if (is_private(use.name)) {
+          uses.push_back(use);
+        }
+        continue;
+
+      default:
+        break;
+    }
+    for (node_list_t::reverse_iterator ii = node->childNodes().rbegin(); ii != node->childNodes().rend(); ++ii) {
+      member_walk_t child = {*ii, self, NULL};
+      pending.push_back(child);
+    }
+  }
+}
 
-  // Special case for 'for (i in o)' and 'i = ...'.
-  // In these cases, if 'i' is not declared before, we treat it as a global
-  // variable. It is most likely the developer forgot to put a 'var' before
-  // the variable name, and we give out a warning.
-  if (typeid(*node) == typeid(NodeAssignment) ||
-      typeid(*node) == typeid(NodeForIn)) {
-    NodeIdentifier* var =
-        dynamic_cast<NodeIdentifier*>(node->childNodes().front());
-    if (var && !scope->declared(var->name())) {
-      // 1. assignment to an undeclared variable is made in a local scope, or
-      // 2. for-in loop variable is not declared.
-      if (!scope->is_global() || typeid(*node) == typeid(NodeForIn)) {
-        WARN("'%s' at line %d is not declared, 'var %s'?\n",
-             var->name().c_str(), var->lineno(), var->name().c_str());
-        this->_global_scope->reserve(var->name());
+// The members and statics of a class spec, and what `this` is in its methods
+void MemberRenaming::find_spec_uses(const string& name, Node* spec, const string* self,
+                                    vector<member_walk_t>& pending, vector<member_use_t>& uses) {
+  const string* instance = instance_domain(name);
+  for_nodes(spec, ii) {
+    string key;
+    Node* value = (*ii)->childNodes().back();
+    literal_key((*ii)->childNodes().front(), key);
+    const string* domain = key == "construct" || key == "members" ? instance :
+                           key == "statics" ? static_domain(name) : NULL;
+    if ((key != "members" && key != "statics") ||
+        value == NULL || value->kind() != NODE_OBJECT_LITERAL) {
+      member_walk_t walk = {value, self, domain};
+      pending.push_back(walk);
+      continue;
+    }
+    for_nodes(value, jj) {
+      Node* member = (*jj)->childNodes().front();
+      member_use_t use = {domain, "", NULL};
+      if (literal_key(member, use.name) && is_private(use.name)) {
+        if (member->kind() == NODE_IDENTIFIER) {
+          use.identifier = static_cast<NodeIdentifier*>(member);
+        } else {
+          use.domain = NULL;
+        }
+        uses.push_back(use);
       }
+      member_walk_t walk = {(*jj)->childNodes().back(), self, domain};
+      pending.push_back(walk);
     }
-    // Fall through to process the rest part of statement.
   }
+}
 
-  for_nodes(node, ii) {
-    build_scope(*ii, scope);
+struct compare_member_counts {
+  const map<string, unsigned int>& counts;
+  explicit compare_member_counts(const map<string, unsigned int>& counts) : counts(counts) {}
+  bool operator()(const string& left, const string& right) const {
+    unsigned int left_count = counts.find(left)->second;
+    unsigned int right_count = counts.find(right)->second;
+    return left_count != right_count ? left_count > right_count : left < right;
+  }
+};
+
+// Names each domain's members, most used first, from fresh names that aren't
+// any of the members that have to be left alone. Members that had a name in
+// an earlier build that's still free keep it, and the rest come after.
+void MemberRenaming::choose_names(const vector<member_use_t>& uses) {
+  map<const string*, map<string, unsigned int> > counts;
+  for (vector<member_use_t>::const_iterator ii = uses.begin(); ii != uses.end(); ++ii) {
+    if (ii->domain == NULL) {
+      _unsafe.insert(ii->name);
+    } else {
+      ++counts[ii->domain][ii->name];
+    }
+  }
+  for (map<const string*, map<string, unsigned int> >::iterator ii = counts.begin(); ii != counts.end(); ++ii) {
+    vector<string> names;
+    for (map<string, unsigned int>::iterator jj = ii->second.begin(); jj != ii->second.end(); ++jj) {
+      if (!_unsafe.count(jj->first)) {
+        names.push_back(jj->first);
+      }
+    }
+    sort(names.begin(), names.end(), compare_member_counts(ii->second));
+
+    map<string, string>& renamed = _names[ii->first];
+    set<string> taken;
+    vector<string> rest;
+    for (vector<string>::iterator jj = names.begin(); jj != names.end(); ++jj) {
+      const string* previous = _rename_map == NULL ? NULL : _rename_map->previous(*ii->first, *jj);
+      if (previous != NULL && is_private(*previous) && is_identifier(*previous) &&
+          !_unsafe.count(*previous) && taken.insert(*previous).second) {
+        renamed[*jj] = *previous;
+      } else {
+        rest.push_back(*jj);
+      }
+    }
+    NameFactory factory("_");
+    for (vector<string>::iterator jj = rest.begin(); jj != rest.end(); ++jj) {
+      string new_name = factory.next();
+      while (_unsafe.count(new_name) || taken.count(new_name)) {
+        new_name = factory.next();
+      }
+      renamed[*jj] = new_name;
+    }
+    if (_rename_map != NULL) {
+      for (map<string, string>::iterator jj = renamed.begin(); jj != renamed.end(); ++jj) {
+        _rename_map->record(*ii->first, jj->first, jj->second);
+      }
+    }
   }
 }
 
+void MemberRenaming::process(NodeProgram* root) {
+  _renamed = 0;
+  _error.clear();
+  _extends.clear();
+  _names.clear();
+  _unsafe.clear();
+
+  // Every package is read twice: once to find the classes, since a class
+  // can be used before it's installed, and once to find the members.
+  vector<NodeProgram*> packages;
+  for (vector<string>::iterator ii = _packages.begin(); ii != _packages.end() && _error.empty(); ++ii) {
+    FILE* file = fopen(ii->c_str(), "r");
+    if (file == NULL) {
+      _error = "can't read " + *ii;
+      break;
+    }
+    try {
+      packages.push_back(new NodeProgram(file, PARSE_INDEX));
+      find_classes(packages.back());
+    } catch (const ParseException& ex) {
+      _error = *ii + ": " + ex.what();
+    }
+    fclose(file);
+  }
+  vector<member_use_t> uses;
+  for (vector<NodeProgram*>::iterator ii = packages.begin(); ii != packages.end(); ++ii) {
+    if (_error.empty()) {
+      find_uses(*ii, uses);
+    }
+    delete *ii;
+  }
+  if (!_error.empty()) {
+    return;
+  }
+  choose_names(uses);
+
+  // The program is some package from the set, maybe with code taken out.
+  // Anything it does with a member that the packages don't account for
+  // means it isn't, and renaming it could break it.
+  root->buildIndex();
+  uses.clear();
+  find_uses(root, uses);
+  vector<pair<NodeIdentifier*, string*> > renames;
+  for (vector<member_use_t>::iterator ii = uses.begin(); ii != uses.end(); ++ii) {
+    if (_unsafe.count(ii->name)) {
+      continue;
+    }
+    map<string, string>::iterator renamed;
+    if (ii->domain != NULL && ii->identifier != NULL) {
+      map<string, string>& names = _names[ii->domain];
+      renamed = names.find(ii->name);
+      if (renamed != names.end()) {
+        renames.push_back(make_pair(ii->identifier, &renamed->second));
+        continue;
+      }
+    }
+    char line[16];
+    snprintf(line, sizeof(line), "%u", ii->identifier != NULL ? ii->identifier->lineno() : 0);
+    _error = "line " + string(line) + ": " + ii->name + " is used in a way the packages don't show";
+    return;
+  }
+  set<string> members;
+  for (vector<pair<NodeIdentifier*, string*> >::iterator ii = renames.begin(); ii != renames.end(); ++ii) {
+    members.insert(ii->first->name() + " " + *ii->second);
+    ii->first->rename(*ii->second);
+  }
+  _renamed = members.size();
+}
 
 // ----- PropertyRenaming -----
 // Unsafe
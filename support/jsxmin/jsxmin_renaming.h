@@ -2,82 +2,181 @@
 #define _JSXMIN_RENAMING_H_
 
 #include "abstract_compiler_pass.h"
+#include "jsxmin_rename_map.h"
 #include "libfbjs/node.hpp"
+#include "libfbjs/scope.hpp"
 #include "reduce.hpp"
 
 #include <string>
 #include <map>
 #include <set>
+#include <vector>
 
 using namespace std;
 
-// A helper class to regenerate variable names.
+// A helper class to regenerate variable names. Names are made of the
+// characters of an alphabet, the ones that come first in it first: every one
+// character name, then every two character name, and so on. Keywords are
+// skipped. After a prefix, names don't start with another underscore, so
+// that names prefixed by one keep to exactly one.
 class NameFactory {
 public:
-  NameFactory() : _current("a"), _prefix("") {}
-  NameFactory(const string& prefix) : _current("a"), _prefix(prefix) {}
+  NameFactory() : _prefix(""), _next(0) { set_alphabet(DEFAULT_ALPHABET); }
+  NameFactory(const string& prefix) : _prefix(prefix), _next(0) {
+    set_alphabet(DEFAULT_ALPHABET);
+  }
+  NameFactory(const string& prefix, const string& alphabet) :
+      _prefix(prefix), _next(0) {
+    set_alphabet(alphabet);
+  }
 
   // Allows prefix to be reset.
   void set_prefix(const string& prefix) {
     _prefix = prefix;
+    set_alphabet(_alphabet);
   }
 
   string next();
 
+  // Every character a name can have: letters, `$`, `_` and digits.
+  static const char* const DEFAULT_ALPHABET;
+
+  // The default alphabet, most frequent character first by `counts`, which
+  // has one count for each possible char value.
+  static string alphabet(const vector<long>& counts);
+
 private:
-  string _current;
+  void set_alphabet(const string& alphabet);
+
   string _prefix;
+  string _alphabet;
+
+  // The characters of the alphabet a name can start with
+  string _leading;
+  unsigned long _next;
 };
 
-// A class represent a JavaScript variable naming scope.
-typedef map<string, string> rename_t;
-typedef set<string> names_t;
+// A class represent a JavaScript variable naming scope. Names are atoms
+// from a table the global scope owns and every scope under it shares.
+typedef vector<fbjs::atom_t> atom_list_t;
 
 class Scope {
 public:
-  explicit Scope(Scope* parent) : _parent(parent) {}
+  explicit Scope(Scope* parent);
   virtual ~Scope() {}
 
   virtual bool is_global() { return false; }
 
   // Declares a variable name in the current scope.
-  // Called when seeing a variable/function declaration.
-  void declare(string name);
+  // Called when seeing a variable/function declaration. `uses` counts the
+  // identifiers that will get its new name; declaring a name again adds to
+  // it.
+  void declare(const string& name, unsigned int uses = 0);
 
   // Checks whether a variable name is declared in the scope chain.
-  bool declared(string name);
+  bool declared(const string& name);
 
   // Prevents a variable name from being renamed.
   void reserve(const string& name) {
-    rename_internal(name, name);
+    fbjs::atom_t atom = _atoms->intern(name);
+    rename_internal(atom, atom);
+  }
+
+  // Has a variable declared in this scope keep its name when the others
+  // are renamed, since code the renamer can't see refers to it by name.
+  void keep(const string& name) {
+    _kept.set(_atoms->intern(name), 1);
   }
 
   // Rename variables declared in this scope using information
   // in the scope chain.
   virtual void rename_vars() = 0;
 
-  // Checks whether a name is taken in the renaming process.
-  bool in_use(string name);
+  // Checks whether a name is taken in the renaming process in this scope.
+  bool in_use(const string& name) {
+    return in_use(_atoms->intern(name));
+  }
+
+  // Keeps a name from being given to anything declared in this scope,
+  // without declaring it. Called with the new names of the variables from
+  // around this scope that it refers to.
+  void avoid(const string& name) {
+    mark_in_use(_atoms->intern(name));
+  }
+
+  // Keeps every name `scope` has taken or avoids from being given to
+  // anything declared in this one.
+  void avoid_all(const Scope* scope) {
+    if (scope->_in_use.size() > _in_use.size()) {
+      _in_use.resize(scope->_in_use.size());
+    }
+    for (size_t ii = 0; ii < scope->_in_use.size(); ++ii) {
+      if (scope->_in_use[ii]) {
+        _in_use[ii] = true;
+      }
+    }
+  }
 
   // Returns new name of an original variable name after renaming.
   // Note that renaming process is performed in rename_vars function.
   // This function returns the renaming result.
-  string new_name(string orig_name);
+  string new_name(const string& orig_name);
+
+  // Asks for the variables declared so far to get the names they were given
+  // under `context` in an earlier build. rename_vars() only keeps to them
+  // where nothing this scope has to avoid has taken the name since.
+  void prefer_names(const RenameMap& names, const string& context);
+
+  // Records the new names of this scope's variables under `context`.
+  void record_names(RenameMap& names, const string& context);
 
   void dump();
 
 protected:
   // A helper function assigns a new name to an existing variable name.
-  void rename_internal(const string& var_name, const string& new_name) {
-    _replacement[var_name] = new_name;
-    _new_names.insert(new_name);
+  void rename_internal(fbjs::atom_t var_name, fbjs::atom_t new_name) {
+    _replacement.set(var_name, new_name);
+    mark_in_use(new_name);
+  }
+
+  void mark_in_use(fbjs::atom_t name) {
+    if (name >= _in_use.size()) {
+      _in_use.resize(name + 1);
+    }
+    _in_use[name] = true;
+  }
+
+  bool in_use(fbjs::atom_t name) {
+    return name < _in_use.size() && _in_use[name];
   }
 
+  // Declared names in alphabetical order.
+  atom_list_t sorted_names();
+
+  // Declared names, most used first and alphabetically among equals.
+  atom_list_t ranked_names();
+
+  fbjs::AtomTable* _atoms;
+
   // Local variables and rename mapping.
-  rename_t _replacement;
+  fbjs::AtomMap _replacement;
+
+  // New names taken in this scope and names it has to avoid, by atom.
+  // Names in use around a scope only matter here when they're avoided, so
+  // a nested function can reuse the short names of outer variables it never
+  // refers to.
+  vector<bool> _in_use;
+
+  // Declared names, in the order they were first declared, and how many
+  // times each is used.
+  atom_list_t _declared;
+  fbjs::AtomMap _uses;
 
-  // A cache of new names
-  names_t _new_names;
+  // Names variables had in an earlier build.
+  fbjs::AtomMap _preferred;
+
+  // Variables that keep their names.
+  fbjs::AtomMap _kept;
 
   // Note that, _parent is not ref counted, it assumes that a scope is
   // associated with a stack, so the parent scope always outlives child
@@ -88,10 +187,22 @@ protected:
 // A class representing a local variable naming scope.
 class LocalScope : public Scope {
 public:
-  explicit LocalScope(Scope* parent) : Scope(parent) {}
+  // Short names go to the most used variables first. If
+  // in_declaration_order is set, they're handed out in the order variables
+  // are declared instead. That way the first argument of every function
+  // gets the same name, which gzip likes. New names are made of the
+  // characters of `alphabet`, which has to outlive the scope.
+  LocalScope(Scope* parent, const string& alphabet, bool in_declaration_order = false) :
+    Scope(parent), _alphabet(alphabet), _in_declaration_order(in_declaration_order) {}
   virtual void rename_vars();
+
+  // Whether rename_vars() will give anything a new name, rather than every
+  // variable here keeping its own.
+  bool renames_any();
 private:
-  bool need_rename(const string& var_name);
+  bool need_rename(fbjs::atom_t var_name);
+  const string& _alphabet;
+  bool _in_declaration_order;
 };
 
 
@@ -99,6 +210,7 @@ private:
 class GlobalScope : public Scope {
 public:
   GlobalScope(bool rename_private);
+  virtual ~GlobalScope();
   virtual void rename_vars();
 
   virtual bool is_global() { return true; }
@@ -115,31 +227,169 @@ private:
 
 class VariableRenaming : public fbjs::AbstractCompilerPass {
 public:
-  VariableRenaming();
+  // With more than one thread, identifiers are renamed in parallel. New
+  // names are all chosen beforehand, so the output is the same either way.
+  // Given `names`, variables get the names they had in the build that saved
+  // it where they still can, and the names they get are recorded in it.
+  VariableRenaming(bool in_declaration_order = false, unsigned int threads = 1,
+                   RenameMap* names = NULL);
   virtual ~VariableRenaming();
 
   // Overrides Compiler::Pass::process
   virtual void process(fbjs::NodeProgram* root);
 
+  // Variables in the last program processed that kept their names because
+  // of eval or with, and about how many bytes renaming them would have
+  // saved had each got a one character name.
+  unsigned int kept() const { return _kept_count; }
+  unsigned long kept_bytes() const { return _kept_bytes; }
+
 private:
-  // Minifies variable names in a subtree rooted from node using the current
-  // local scope and file scope info. The last parameter decides which
-  // scope should be used.
-  void minify(fbjs::Node* node, Scope* scope);
+  // Finds the bindings eval or with could see by name. See
+  // jsxmin_renaming.cpp.
+  void find_kept(fbjs::NodeProgram* root);
+
+  // Whether a binding from the program's ScopeTree would be renamed if
+  // eval and with didn't keep it from it.
+  bool renamable(unsigned int binding);
+
+  // Gives every function that can be renamed a local scope and new names
+  // for its variables, outermost functions first.
+  void rename_scopes();
+
+  // Tells each scope in the tree apart from the others in a way that
+  // doesn't change between builds unless the code around it does.
+  void name_scopes();
+
+  // Orders the alphabet of new names by how often each character shows up
+  // in the program once it's renamed.
+  void choose_alphabet(fbjs::NodeProgram* root);
 
-  // Build a local scope from a root node (typically a function node)
-  void build_scope(fbjs::Node* node, Scope* scope);
+  // Declares the variables the program's ScopeTree has in `tree_scope`,
+  // along with those of catch clauses in it that share its names.
+  void declare_bindings(Scope* scope, unsigned int tree_scope);
 
-  // Checks if a function contains 'with' or 'eval' statements.
-  bool function_has_with_or_eval(fbjs::Node* node);
+  // Names the one variable of a catch clause, or a function expression's
+  // own name, in a scope of its own. See jsxmin_renaming.cpp.
+  LocalScope* rename_inner_scope(Scope* parent, unsigned int around,
+                                 unsigned int names, const string& context);
 
-  // Generates a new (shorter) id based on the current scope.
-  string generate_id(const char t, const Scope* scope, const string& orig_name);
+  // The function or global scope a catch clause is in, or the scope itself
+  // if it's not a catch clause.
+  unsigned int function_of(unsigned int tree_scope);
+
+  // Whether a catch clause's variable is named along with the variables of
+  // the function around it instead of on its own.
+  bool shares_catch(unsigned int tree_scope);
+
+  // The name a binding from the program's ScopeTree ends up with, which is
+  // its own name unless it's renamed.
+  string new_name(unsigned int binding);
+
+  // Renames every reference to a binding from the program's ScopeTree.
+  void rename_binding(unsigned int binding);
+  static void* run_worker(void* renaming);
 
   GlobalScope* _global_scope;
+  const fbjs::ScopeTree* _scope_tree;
+  bool _in_declaration_order;
+  string _alphabet;
+
+  // Naming scope of each scope in the tree. Some catch clauses share the
+  // scope of the function around them, see shares_catch().
+  vector<Scope*> _scopes;
+
+  // The scope a function expression's own name is named in, between the
+  // function and the scope around it, or NULL if its name stays the same.
+  vector<Scope*> _self_scopes;
+
+  // Bindings that keep their names because of eval or with, and for each
+  // scope, those of them declared in it or in scopes nested in it. A new
+  // name given in a scope mustn't be one of the latter.
+  vector<bool> _kept;
+  vector<vector<unsigned int> > _kept_in;
+  unsigned int _kept_count;
+  unsigned long _kept_bytes;
+
+  // Names kept between builds, and the context each scope's names are kept
+  // under.
+  RenameMap* _rename_map;
+  vector<string> _contexts;
+
+  // Bindings are renamed on a pool of threads, which take them a batch at a
+  // time.
+  unsigned int _threads;
+  size_t _next_binding;
 };
 
 
+// Renames the private members of classes made with JX.install(): names
+// with one leading underscore, used on `this` in a class's methods or on the
+// class itself as JX.Name._member. Every class that extends another shares
+// its members, so names are chosen per family of classes. Other families are
+// free to reuse them. Since a family can span packages, the names come from
+// all of the packages that get built together, read from their sources, and
+// every package in the set gets the same names. See jsxmin_renaming.cpp.
+class MemberRenaming : public fbjs::AbstractCompilerPass {
+public:
+  // `packages` are the source files of every package built along with this
+  // one, its own included. Given `names`, members keep the names they had
+  // in the build that saved it where they still can. Every package in the
+  // set has to be given the same one, since they all have to agree.
+  MemberRenaming(const vector<string>& packages, RenameMap* names = NULL);
+  virtual ~MemberRenaming() {}
+
+  // Renames nothing and sets error() if the program uses a member the
+  // packages don't account for.
+  virtual void process(fbjs::NodeProgram* root);
+
+  // Members renamed in the last program processed.
+  unsigned int renamed() const { return _renamed; }
+  const string& error() const { return _error; }
+
+private:
+  // A private member name as it's used somewhere, and the objects it's used
+  // on: the instances of a family, a class, or unknown if domain is NULL.
+  struct member_use_t {
+    const string* domain;
+    string name;
+    fbjs::NodeIdentifier* identifier;
+  };
+
+  // A node still to be walked, where `this` is in `self`. If it's a function,
+  // `this` inside it is in `method`.
+  struct member_walk_t {
+    fbjs::Node* node;
+    const string* self;
+    const string* method;
+  };
+
+  void find_classes(fbjs::NodeProgram* root);
+  void find_uses(fbjs::NodeProgram* root, vector<member_use_t>& uses);
+  void find_spec_uses(const string& name, fbjs::Node* spec, const string* self,
+                      vector<member_walk_t>& pending, vector<member_use_t>& uses);
+  const string* instance_domain(const string& name);
+  const string* static_domain(const string& name);
+  void choose_names(const vector<member_use_t>& uses);
+
+  vector<string> _packages;
+
+  // The class each class extends, "" if none, or "?" if it can't be told.
+  map<string, string> _extends;
+
+  // Names of the objects members are used on. Uses point into this.
+  set<string> _domains;
+
+  // New names by domain and old name, and the names that are used in ways
+  // that can't be renamed.
+  map<const string*, map<string, string> > _names;
+  set<string> _unsafe;
+  RenameMap* _rename_map;
+
+  unsigned int _renamed;
+  string _error;
+};
+
 // Rename properties, unsafe.
 class PropertyRenaming : public fbjs::AbstractCompilerPass {
 public:
@@ -0,0 +1,148 @@
+#include "libfbjs/node.hpp"
+
+#include "pass_manager.h"
+
+#include <stdexcept>
+
+using namespace fbjs;
+using namespace std;
+
+void PassManager::add(AbstractCompilerPass* pass) {
+  pass_t entry = { pass, NULL };
+  _pipeline.push_back(entry);
+}
+
+void PassManager::add(LocalPass* pass) {
+  pass_t entry = { NULL, pass };
+  _pipeline.push_back(entry);
+}
+
+void PassManager::after(LocalPass* later, LocalPass* earlier) {
+  _after.insert(make_pair(later, earlier));
+}
+
+void PassManager::process(NodeProgram* root) {
+  _traversals = 0;
+  size_t ii = 0;
+  while (ii < _pipeline.size()) {
+    ++_traversals;
+    if (_pipeline[ii].local == NULL) {
+      _pipeline[ii++].pass->process(root);
+      continue;
+    }
+
+    // Take as many local passes as can share this traversal
+    size_t first = ii;
+    _fused.clear();
+    do {
+      _fused.push_back(_pipeline[ii++].local);
+    } while (ii < _pipeline.size() && can_fuse(first, ii));
+
+    bool remove = false;
+    if (walk(root, remove) != root || remove) {
+      throw logic_error("local pass tried to replace the program node");
+    }
+  }
+  _fused.clear();
+}
+
+// Can pipeline[pass] join the traversal that starts at pipeline[first]?
+bool PassManager::can_fuse(size_t first, size_t pass) const {
+  LocalPass* local = _pipeline[pass].local;
+  if (local == NULL) {
+    return false;
+  }
+  for (size_t ii = first; ii < pass; ++ii) {
+    LocalPass* earlier = _pipeline[ii].local;
+    if ((earlier->hooks() & LocalPass::LEAVE) &&
+        (local->hooks() & LocalPass::ENTER)) {
+      return false;
+    }
+    if (_after.find(make_pair(local, earlier)) != _after.end()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+namespace {
+  struct walk_frame_t {
+    Node* original; // node as it stands in its parent
+    Node* node; // node that will take its place
+    Node* parent;
+    size_t first; // first pass that gets to see node
+    bool remove;
+    node_list_t::iterator child; // next child to visit
+  };
+}
+
+// Runs one kind of hook for each pass from frame.first on
+static void run_hooks(const vector<LocalPass*>& passes, LocalPass::hook_t hook, walk_frame_t& frame) {
+  for (size_t ii = frame.first; ii < passes.size() && frame.node != NULL; ++ii) {
+    if (!(passes[ii]->hooks() & hook)) {
+      continue;
+    }
+    Node* result = hook == LocalPass::ENTER ?
+      passes[ii]->enter(frame.node, frame.parent, frame.remove) :
+      passes[ii]->leave(frame.node, frame.parent, frame.remove);
+    if (frame.remove || result != frame.node) {
+      if (frame.node != frame.original) {
+        delete frame.node;
+      }
+      frame.node = frame.remove ? NULL : result;
+      if (hook == LocalPass::ENTER) {
+        // The replacement is only for the passes after this one to see
+        frame.first = ii + 1;
+      }
+    }
+  }
+  if (hook == LocalPass::ENTER && frame.node != NULL) {
+    frame.child = frame.node->childNodes().begin();
+  }
+}
+
+// Runs the fused passes over a subtree. Returns the node that should take
+// `root`'s place, or NULL with `remove` set. The tree is walked off an
+// explicit stack so that deeply nested code can't overflow the C stack.
+Node* PassManager::walk(Node* root, bool& remove) {
+  vector<walk_frame_t> stack;
+  walk_frame_t frame = { root, root, NULL, 0, false, node_list_t::iterator() };
+  stack.push_back(frame);
+  run_hooks(_fused, LocalPass::ENTER, stack.back());
+
+  while (true) {
+    walk_frame_t& top = stack.back();
+    if (top.node != NULL && top.child != top.node->childNodes().end()) {
+      if (*top.child == NULL) {
+        ++top.child;
+      } else {
+        walk_frame_t frame = { *top.child, *top.child, top.node, top.first, false, node_list_t::iterator() };
+        stack.push_back(frame);
+        run_hooks(_fused, LocalPass::ENTER, stack.back());
+      }
+      continue;
+    }
+
+    // All children are done
+    if (!top.remove) {
+      run_hooks(_fused, LocalPass::LEAVE, top);
+    }
+    walk_frame_t done = top;
+    stack.pop_back();
+    if (stack.empty()) {
+      remove = done.remove;
+      return done.node;
+    }
+
+    walk_frame_t& parent = stack.back();
+    Node* old_child = NULL;
+    if (done.remove) {
+      old_child = parent.node->removeChild(parent.child++);
+    } else if (done.node != done.original) {
+      old_child = parent.node->replaceChild(done.node, parent.child++);
+    } else {
+      ++parent.child;
+    }
+    delete old_child;
+  }
+}
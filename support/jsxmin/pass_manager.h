@@ -0,0 +1,91 @@
+#ifndef _PASS_MANAGER_H_
+#define _PASS_MANAGER_H_
+
+#include "abstract_compiler_pass.h"
+
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace fbjs {
+
+class Node;
+
+// A pass that rewrites the tree one node at a time, looking no further than
+// the subtree it is handed. Local passes don't walk the tree themselves;
+// PassManager walks it for them, so several of them can share one traversal.
+class LocalPass {
+public:
+  enum hook_t { ENTER = 1, LEAVE = 2 };
+
+  // `hooks` says which of enter() and leave() the pass implements.
+  LocalPass(int hooks) : _hooks(hooks) {}
+  virtual ~LocalPass() {}
+
+  // Both hooks get the node being visited and its parent, and return the
+  // node that should take its place: the same node to leave it be, another
+  // one to replace it, or NULL for an empty slot. Setting `remove` drops it
+  // from its parent instead. Either way the manager deletes the old node.
+  // enter() is called before the node's children are visited, leave() after.
+  virtual Node* enter(Node* node, Node* parent, bool& remove) { return node; }
+  virtual Node* leave(Node* node, Node* parent, bool& remove) { return node; }
+
+  int hooks() const { return _hooks; }
+
+private:
+  int _hooks;
+};
+
+// Runs a pipeline of passes, fusing consecutive local passes into a single
+// traversal wherever that can't change the result. In a fused traversal each
+// node gets the enter() hooks of every pass in order, then its children are
+// visited, then it gets the leave() hooks. That is the same as running the
+// passes one after another, except where a pass needs to see what an earlier
+// one made of the whole tree. So a new traversal starts:
+//   1. at every AbstractCompilerPass, since those walk the tree themselves;
+//   2. at a pass with an enter() hook that follows one with a leave() hook,
+//      since it would see nodes the earlier pass hasn't got to yet;
+//   3. wherever after() says one pass depends on the output of another.
+// A node a pass swaps in is not shown to that pass or any before it, as if
+// each had run over the tree separately. Leave hooks should build their
+// replacements out of nodes that have already been visited.
+class PassManager : public AbstractCompilerPass {
+public:
+  PassManager() : _traversals(0) {}
+  virtual ~PassManager() {}
+
+  // Appends a pass to the pipeline. The manager does not take ownership.
+  void add(AbstractCompilerPass* pass);
+  void add(LocalPass* pass);
+
+  // Declares that `later` must only see the tree once `earlier` is done with
+  // all of it, so the two never share a traversal.
+  void after(LocalPass* later, LocalPass* earlier);
+
+  virtual void process(NodeProgram* root);
+
+  // Number of passes in the pipeline.
+  unsigned int passes() const { return _pipeline.size(); }
+
+  // Tree traversals made by the last call to process(), and how many fewer
+  // that is than running each pass on its own.
+  unsigned int traversals() const { return _traversals; }
+  unsigned int saved() const { return passes() - _traversals; }
+
+private:
+  struct pass_t {
+    AbstractCompilerPass* pass;
+    LocalPass* local;
+  };
+
+  bool can_fuse(size_t first, size_t pass) const;
+  Node* walk(Node* root, bool& remove);
+
+  std::vector<pass_t> _pipeline;
+  std::set<std::pair<LocalPass*, LocalPass*> > _after;
+  std::vector<LocalPass*> _fused;
+  unsigned int _traversals;
+};
+
+} // namespace
+#endif
@@ -25,7 +25,7 @@ using namespace fbjs;
 using namespace std;
 
 // Returns true if a given id is reserved JS keywords, see ECMA-262 sect 7.5.1
-static bool is_reserved_keyword(string id) {
+bool is_reserved_keyword(const string& id) {
   static set<string> keyword_set;
   static bool initialized = false;
   if (!initialized) {
@@ -59,7 +59,7 @@ static bool is_reserved_keyword(string id) {
 
 // Returns true if a given string is a JS identifier.
 // NOTE: the function does not recognize escaped unicode as identifiers
-static bool is_identifier(string id) {
+bool is_identifier(const string& id) {
   // "[a-zA-Z$_][a-zA-Z$_0-9]*]"
   if (id.size() == 0) return false;
 
@@ -86,7 +86,7 @@ static bool is_identifier(string id) {
 
 void ReductionWalker::visit(NodeExpression& node) {
   visitChildren();
-  if (dynamic_cast<NodeStatementList*>(parent()->node())) {
+  if (dynamic_cast<NodeStatementList*>(parentNode())) {
     if (node.compare(true) || node.compare(false)) {
       // If I'm the direct child of a statement list and have no side-effects; I
       // can be removed.
@@ -201,7 +201,7 @@ void ReductionWalker::visit(NodeIf& node) {
         // whole if/else node. But if we're a child of an if statement, we can
         // not remove the node or we'll leave the parent with a surprising and
         // segfaulty number of child nodes, e.g. if (x) {} else if (0) {}
-        if (dynamic_cast<NodeStatementList*>(parent()->node())) {
+        if (dynamic_cast<NodeStatementList*>(parentNode())) {
           remove();
         } else {
           replace(NULL);
@@ -20,18 +20,26 @@
 
 #pragma once
 #include "libfbjs/node.hpp"
-#include "libfbjs/walker.hpp"
+#include "libfbjs/static_walker.hpp"
+#include <string>
 
-class ReductionWalker : public fbjs::NodeWalker {
+// Whether a name is a keyword, a future reserved word, or a literal like
+// `null`, none of which can be used as an identifier.
+bool is_reserved_keyword(const std::string& id);
+
+// Whether a name can be used as an identifier: it's made of the characters
+// identifiers are, and it isn't a keyword or a literal like `null`.
+bool is_identifier(const std::string& id);
+
+class ReductionWalker : public fbjs::StaticNodeWalker<ReductionWalker> {
   public:
-    using fbjs::NodeWalker::visit;
-    virtual fbjs::NodeWalker* clone() const { return new ReductionWalker; }
-    virtual void visit(fbjs::NodeExpression&);
-    virtual void visit(fbjs::NodeOperator&);
-    virtual void visit(fbjs::NodeUnary&);
-    virtual void visit(fbjs::NodeConditionalExpression&);
-    virtual void visit(fbjs::NodeFunctionCall&);
-    virtual void visit(fbjs::NodeIf&);
-    virtual void visit(fbjs::NodeObjectLiteralProperty&);
-    virtual void visit(fbjs::NodeDynamicMemberExpression&);
+    using fbjs::StaticNodeWalker<ReductionWalker>::visit;
+    void visit(fbjs::NodeExpression&);
+    void visit(fbjs::NodeOperator&);
+    void visit(fbjs::NodeUnary&);
+    void visit(fbjs::NodeConditionalExpression&);
+    void visit(fbjs::NodeFunctionCall&);
+    void visit(fbjs::NodeIf&);
+    void visit(fbjs::NodeObjectLiteralProperty&);
+    void visit(fbjs::NodeDynamicMemberExpression&);
 };
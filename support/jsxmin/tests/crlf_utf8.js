@@ -0,0 +1,28 @@
+// Windows line endings and text beyond ASCII, in comments (déjà vu, 日本語)
+// as well as in code. Lines end without semicolons here and there, so
+// code copied from the source has to keep its line breaks.
+var greeting = 'Grüße, 世界'
+var table = {
+  'ключ': 'значение',
+  emoji: '😀',
+  joined: 'one \
+two'
+}
+var pattern = /[à-ÿ]+ü/
+
+function describe(value) {
+  /* größer als
+     ∞ */
+  var parts = []
+  for (var key in value) {
+    parts.push(key + '=' + value[key].length)
+  }
+  return parts.sort().join(', ')
+}
+
+console.log(JSON.stringify([
+  greeting.length,
+  describe(table),
+  pattern.test('éüü'),
+  pattern.test('eu')
+]))
@@ -0,0 +1,52 @@
+// Variables that eval or with can see keep their names, and everything else
+// around them is still renamed. Run by run.sh, which checks that this prints
+// the same thing minified as it does as is.
+var out = [];
+
+// Every one letter name as a property, so that a with statement over it
+// would pick up any short name given to a variable its body refers to
+var letters = {};
+for (var code = 97; code <= 122; ++code) {
+  letters[String.fromCharCode(code)] = 1000;
+  letters[String.fromCharCode(code - 32)] = 1000;
+}
+
+function outer(alpha, beta) {
+  var gamma = alpha + beta;
+  var unusedLong = 7;
+  function helper(first, second) { var total = first * second; return total + gamma; }
+  function evaluator(code) { var local = 3; return eval(code); }
+  out.push(evaluator('alpha + beta + gamma + local'));
+  out.push(helper(2, 3));
+  return function inner(delta) { var epsilon = delta * 2; return epsilon + unusedLong; };
+}
+out.push(outer(1, 2)(5));
+function withUser(obj) {
+  var count = 10, other = 20, third = 30;
+  function nested(value) { var doubled = value * 2; return doubled; }
+  with (obj) {
+    out.push(count + nested(other));
+    out.push(function (param) { var q = param + third; return q; }(1));
+  }
+  var shadowMe = 5;
+  return shadowMe + third;
+}
+out.push(withUser({count: 100}));
+out.push(withUser(letters));
+function deep() {
+  var x1 = 1, longer = 2;
+  function mid() {
+    var m1 = 5, m2 = 6;
+    try { throw 4; } catch (err) { out.push(eval('err + m1 + x1')); }
+    return m2 + longer;
+  }
+  function sib(aaa, bbb) { var ccc = aaa + bbb; return ccc; }
+  return mid() + sib(7, 8);
+}
+out.push(deep());
+var f = function named(n) { return n ? n + named(n - 1) : eval('typeof named'); };
+out.push(String(function w(){ return (function named2(z){ return eval('z + typeof named2'); })(1); }()));
+function A(){ var longOuter=1; function S(o){ var a = 2, b = 3; with(o){ out.push(a + b); } return longOuter + a + b; } return S({}) + S(letters); }
+function B(){ var q1 = 1; try { throw 2; } catch (caught) { var r = function (){ return eval('q1'); }; return caught + r(); } }
+out.push(A(), B());
+console.log(JSON.stringify(out));
@@ -0,0 +1,53 @@
+// Old versions of IE also declare a function expression's own name and a
+// catch clause's variable in the function around it. There they must differ
+// from each other and from the function's own variables, or one hides
+// another. Each function is checked from its own source, so the minified
+// copy is checked as minified.
+var out = [];
+
+function outer(longname) {
+  var f = function selfone(n) { return n ? selfone(n - 1) : 'one'; };
+  var g = function selftwo(n) { return n ? selftwo(n - 1) : 'two'; };
+  try { throw 1; } catch (caught) { longname = caught; }
+  return f(2) + g(2) + longname;
+}
+
+function nested(total) {
+  try {
+    throw 'x';
+  } catch (first) {
+    var h = function inner() { return typeof inner; };
+    try { throw 'y'; } catch (second) { total += first + second + h(); }
+  }
+  var k = function other(n) { return n ? other(n - 1) : 'k'; };
+  return total + k(3);
+}
+
+// Whether every name `fn` declares, the ones old IE adds included, is
+// different. Nested functions aren't in the examples above, so everything
+// after the parameters is the function's own.
+function distinct(fn) {
+  var text = String(fn);
+  var header = /^function\s*\w*\s*\(([^)]*)\)/.exec(text);
+  var names = header[1].split(/\s*,\s*/);
+  var body = text.substring(header[0].length);
+  var patterns = [/var\s+(\w+)/g, /function\s+(\w+)/g, /catch\s*\(\s*(\w+)/g];
+  for (var ii = 0; ii < patterns.length; ++ii) {
+    var match;
+    while ((match = patterns[ii].exec(body))) {
+      names.push(match[1]);
+    }
+  }
+  var seen = {};
+  for (var jj = 0; jj < names.length; ++jj) {
+    if (seen.hasOwnProperty(names[jj])) {
+      return 'duplicate ' + names[jj];
+    }
+    seen[names[jj]] = true;
+  }
+  return names.length + ' distinct';
+}
+
+out.push(outer('x'), distinct(outer));
+out.push(nested(''), distinct(nested));
+console.log(JSON.stringify(out));
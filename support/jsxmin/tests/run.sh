@@ -0,0 +1,28 @@
+#!/bin/sh
+
+# Runs each program in this directory under node as written and after jsxmin
+# has minified it, with and without --gzip, and fails if any minified copy
+# prints something different. Point JSXMIN at a binary built elsewhere to
+# check that one instead.
+#
+#   javelin/ $ ./support/jsxmin/tests/run.sh
+
+DIR=`dirname $0`
+JSXMIN=${JSXMIN:-${DIR}/../jsxmin}
+
+STATUS=0
+for TEST in ${DIR}/*.js; do
+  EXPECTED=`node $TEST 2>&1`
+  for FLAGS in "" "--gzip"; do
+    ACTUAL=`$JSXMIN $FLAGS < $TEST | node 2>&1`
+    if [ "$ACTUAL" = "$EXPECTED" ]; then
+      echo "ok: $TEST $FLAGS"
+    else
+      echo "FAILED: $TEST $FLAGS"
+      echo "  expected: $EXPECTED"
+      echo "  got:      $ACTUAL"
+      STATUS=1
+    fi
+  done
+done
+exit $STATUS
@@ -0,0 +1,27 @@
+#!/bin/sh
+
+# Checks RENDER_VERBATIM on the packages, the programs in this directory and
+# crlf_utf8.js repeated past 16 KB, so flex reads it in several pieces. A
+# comment full of 3-byte characters after each copy leaves some of them split
+# between one read and the next. jsbench fails unless an untouched tree
+# renders back to the file byte for byte, and one with every other statement
+# and property changed parses the same as its usual rendering. Point JSBENCH
+# at a binary built elsewhere to check that one instead.
+#
+#   javelin/ $ ./support/jsxmin/tests/verbatim.sh
+
+DIR=`dirname $0`
+JSBENCH=${JSBENCH:-${DIR}/../../jsbench/jsbench}
+
+LARGE=`mktemp`
+trap 'rm -f $LARGE' EXIT
+PAD="//"
+for CHAR in `seq 160`; do
+  PAD="${PAD}∞"
+done
+for COPY in `seq 40`; do
+  cat ${DIR}/crlf_utf8.js >> $LARGE
+  printf '%s\r\n' "$PAD" >> $LARGE
+done
+
+$JSBENCH --runs=1 ${DIR}/../../../pkg/*.dev.js ${DIR}/*.js $LARGE